@@ -0,0 +1,593 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "dictionarySet.h"
+
+/* Allocates a new, empty DictionarySet_t and returns a pointer to it.
+numReaders is the number of threads which will look words up while the
+dictionaries may be updated, each identified by an index below it. */
+DictionarySet_t * newDictionarySet(size_t numReaders) {
+    DictionarySet_t * set = (DictionarySet_t *) malloc(sizeof (DictionarySet_t));
+    set->numDictionaries = 0;
+    pthread_mutex_init(&set->updateMutex, NULL);
+    atomic_init(&set->epoch, 0);
+    set->readers = NULL;
+    if (posix_memalign((void **) &set->readers, 64, sizeof (DictionaryReader_t) * numReaders) != 0) {
+        puts("Couldn't allocate dictionary readers!");
+        exit(EXIT_FAILURE);
+    }
+    set->numReaders = numReaders;
+    for (size_t i = 0; i < numReaders; i++) {
+        atomic_init(&set->readers[i].epoch, DICTIONARY_READER_IDLE);
+        for (size_t j = 0; j < MAX_DICTIONARIES; j++) {
+            atomic_init(&set->readers[i].lookups[j], 0);
+            atomic_init(&set->readers[i].hits[j], 0);
+        }
+    }
+    set->retired = NULL;
+    set->journalFd = -1;
+    return set;
+}
+
+/* Deallocates a DictionarySet_t along with every dictionary loaded to it. No
+thread may be reading it. */
+void destroyDictionarySet(DictionarySet_t * set) {
+    for (size_t i = 0; i < set->numDictionaries; i++) {
+        free(set->dictionaries[i].name);
+        destroyTrie(atomic_load(&set->dictionaries[i].trie));
+        destroyTrie(atomic_load(&set->dictionaries[i].removed));
+    }
+    while (set->retired != NULL) {
+        RetiredTrieNodes_t * next = set->retired->next;
+        freeRetiredTrieNodes(&set->retired->nodes);
+        free(set->retired);
+        set->retired = next;
+    }
+    if (set->journalFd >= 0) {
+        close(set->journalFd);
+    }
+    pthread_mutex_destroy(&set->updateMutex);
+    free(set->readers);
+    free(set);
+}
+
+/* Returns the number of lines in a dictionary file, which is the number of
+words it contains. */
+static size_t countDictionaryWords(char * fileName) {
+    FILE * fp = fopen(fileName, "r");
+    size_t numWords = 0;
+    int c = 0;
+    if (fp == NULL) {
+        return 0;
+    }
+    while ((c = fgetc(fp)) != EOF) {
+        if (c == '\n') {
+            numWords++;
+        }
+    }
+    fclose(fp);
+    return numWords;
+}
+
+/* Returns true if a dictionary named name can be added to the set: the name
+is not taken and the set is not full. */
+static bool canAddDictionaryToSet(DictionarySet_t * set, char * name) {
+    if (set->numDictionaries == MAX_DICTIONARIES) {
+        return false;
+    }
+    for (size_t i = 0; i < set->numDictionaries; i++) {
+        if (strcmp(set->dictionaries[i].name, name) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Adds a dictionary to the end of the set. */
+static void addDictionaryToSet(DictionarySet_t * set, char * name, Trie_t * trie, const StaticTrie_t * builtin,
+        Trie_t * removed, size_t numWords, size_t memoryUsage) {
+    Dictionary_t * dictionary = &set->dictionaries[set->numDictionaries];
+    dictionary->name = strdup(name);
+    atomic_init(&dictionary->trie, trie);
+    dictionary->builtin = builtin;
+    atomic_init(&dictionary->removed, removed);
+    atomic_init(&dictionary->numWords, numWords);
+    atomic_init(&dictionary->memoryUsage, memoryUsage);
+    set->numDictionaries++;
+}
+
+/* Loads the dictionary file fileName into the set under the given name. The
+first dictionary loaded to a set is it's default. Returns false if the file
+could not be read, the name is already taken, or the set is full. */
+bool loadDictionaryToSet(DictionarySet_t * set, char * name, char * fileName, TrieNormalization_t normalization) {
+    if (canAddDictionaryToSet(set, name) == false) {
+        return false;
+    }
+
+    Trie_t * trie = newTrieFromDictionary(fileName, normalization);
+    if (trie == NULL) {
+        return false;
+    }
+
+    addDictionaryToSet(set, name, trie, NULL, NULL, countDictionaryWords(fileName), getTrieMemoryUsage(trie));
+    return true;
+}
+
+/* Adds the words listed in the file fileName which are not already builtin
+words to the trie overlay, so every word of the dictionary is in just one of
+them. Returns the number of words added, or -1 if the file could not be
+read. */
+static ssize_t loadOverlayWords(Trie_t * overlay, const StaticTrie_t * builtin, char * fileName) {
+    FILE * fp = fopen(fileName, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    char * line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length = 0;
+    ssize_t numAdded = 0;
+    while ((length = getline(&line, &lineCapacity, fp)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length > 0 && stringExistsInStaticTrie(builtin, line) == false && stringExistsInTrie(overlay, line) == false) {
+            insertStringToTrie(overlay, line);
+            numAdded++;
+        }
+    }
+    free(line);
+    fclose(fp);
+    return numAdded;
+}
+
+/* Adds a dictionary which was compiled into the program (see gendict.c) to
+the set under the given name. It is used in place, so adding it takes no time
+and no memory however large it is. If overlayFileName is not NULL, the words
+in that file are added to it, normalized with the policy the builtin
+dictionary was generated with. Words added and removed while the server runs
+are kept in tries alongside it. Returns false if the overlay file could not be
+read, the name is already taken, or the set is full. */
+bool addBuiltinDictionaryToSet(DictionarySet_t * set, char * name, const StaticTrie_t * builtin, char * overlayFileName) {
+    if (canAddDictionaryToSet(set, name) == false) {
+        return false;
+    }
+
+    Trie_t * overlay = newTrie(0, false);
+    overlay->normalization = builtin->normalization;
+    size_t numWords = builtin->numWords;
+    if (overlayFileName != NULL) {
+        ssize_t numAdded = loadOverlayWords(overlay, builtin, overlayFileName);
+        if (numAdded < 0) {
+            destroyTrie(overlay);
+            return false;
+        }
+        numWords += numAdded;
+    }
+    Trie_t * removed = newTrie(0, false);
+    removed->normalization = builtin->normalization;
+
+    addDictionaryToSet(set, name, overlay, builtin, removed, numWords,
+            getStaticTrieMemoryUsage(builtin) + getTrieMemoryUsage(overlay) + getTrieMemoryUsage(removed));
+    return true;
+}
+
+/* Parses a comma separated list of dictionary names into a selection of
+dictionaries from the set. Returns false if any of the names is not in the
+set, in which case selection is left unchanged. */
+bool parseDictionarySelection(DictionarySet_t * set, char * names, DictionaryMask_t * selection) {
+    char * list = strdup(names);
+    char * savePtr = NULL;
+    DictionaryMask_t parsed = 0;
+    bool bValid = true;
+
+    for (char * name = strtok_r(list, ",", &savePtr); name != NULL; name = strtok_r(NULL, ",", &savePtr)) {
+        size_t i = 0;
+        while (i < set->numDictionaries && strcmp(set->dictionaries[i].name, name) != 0) {
+            i++;
+        }
+        if (i == set->numDictionaries) {
+            bValid = false;
+            break;
+        }
+        parsed |= (DictionaryMask_t) 1 << i;
+    }
+    free(list);
+
+    if (bValid == false || parsed == 0) {
+        return false;
+    }
+    *selection = parsed;
+    return true;
+}
+
+/* Marks the reader thread with the given index as looking words up in the set,
+until it calls leaveDictionarySet. Trie nodes which an update replaces while
+any reader is inside are kept until the reader has left, so lookups never wait
+for updates and updates never wait for lookups. Entering and leaving costs a
+store each, so readers should stay inside across a batch of lookups. */
+void enterDictionarySet(DictionarySet_t * set, size_t reader) {
+    atomic_store(&set->readers[reader].epoch, atomic_load(&set->epoch));
+}
+
+/* Marks the reader thread with the given index as no longer looking words up
+in the set. */
+void leaveDictionarySet(DictionarySet_t * set, size_t reader) {
+    atomic_store_explicit(&set->readers[reader].epoch, DICTIONARY_READER_IDLE, memory_order_release);
+}
+
+/* Returns true if the null-terminated string is contained in the
+dictionary: in it's builtin words, unless it has been removed from them, or in
+it's trie. */
+static bool stringExistsInDictionary(Dictionary_t * dictionary, char * string) {
+    if (dictionary->builtin != NULL && stringExistsInStaticTrie(dictionary->builtin, string)
+            && stringExistsInTrie(atomic_load_explicit(&dictionary->removed, memory_order_acquire), string) == false) {
+        return true;
+    }
+    return stringExistsInTrie(atomic_load_explicit(&dictionary->trie, memory_order_acquire), string);
+}
+
+/* Returns true if the null-terminated string is contained in any of the
+selected dictionaries of the set. Dictionaries are checked in the order they
+were loaded and the search stops at the first one containing the string. If
+the set may be updated, the calling thread must be inside it (see
+enterDictionarySet). The lookup is counted in the statistics of reader, which
+must be the calling thread's own. */
+bool stringExistsInDictionarySet(DictionarySet_t * set, size_t reader, DictionaryMask_t selection, char * string) {
+    DictionaryReader_t * counts = &set->readers[reader];
+    for (size_t i = 0; i < set->numDictionaries; i++) {
+        if ((selection & ((DictionaryMask_t) 1 << i)) == 0) {
+            continue;
+        }
+
+        Dictionary_t * dictionary = &set->dictionaries[i];
+        //only this reader writes it's counts, so they need no atomic increment
+        atomic_store_explicit(&counts->lookups[i],
+                atomic_load_explicit(&counts->lookups[i], memory_order_relaxed) + 1, memory_order_relaxed);
+        if (stringExistsInDictionary(dictionary, string)) {
+            atomic_store_explicit(&counts->hits[i],
+                    atomic_load_explicit(&counts->hits[i], memory_order_relaxed) + 1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Frees the trie nodes retired by updates which no reader other than the
+updating one can still be using: those retired before every reader inside the
+set entered it. The updating reader is skipped because it holds no nodes
+across a lookup. Must be called with updateMutex held. */
+static void reclaimRetiredTrieNodes(DictionarySet_t * set, size_t updatingReader) {
+    uint64_t oldestEpoch = DICTIONARY_READER_IDLE;
+    for (size_t i = 0; i < set->numReaders; i++) {
+        uint64_t epoch = atomic_load(&set->readers[i].epoch);
+        if (i != updatingReader && epoch < oldestEpoch) {
+            oldestEpoch = epoch;
+        }
+    }
+
+    RetiredTrieNodes_t ** link = &set->retired;
+    while (*link != NULL) {
+        RetiredTrieNodes_t * retired = *link;
+        if (retired->epoch <= oldestEpoch) {
+            *link = retired->next;
+            freeRetiredTrieNodes(&retired->nodes);
+            free(retired);
+        } else {
+            link = &retired->next;
+        }
+    }
+}
+
+/* Appends an update to the journal and waits for it to reach the disk.
+Returns false if it could not be saved, in which case any part of it which
+was written is cut off again so it can never be replayed. */
+static bool writeDictionaryJournal(DictionarySet_t * set, bool bAdd, char * name, char * word) {
+    char * line = (char *) malloc(strlen(name) + strlen(word) + 10);
+    size_t length = sprintf(line, "%s %s %s\n", bAdd ? "add" : "remove", name, word);
+    off_t end = lseek(set->journalFd, 0, SEEK_END);
+    size_t written = 0;
+    bool bSaved = true;
+    while (written < length) {
+        ssize_t result = write(set->journalFd, line + written, length - written);
+        if (result < 0 && errno != EINTR) {
+            bSaved = false;
+            break;
+        }
+        written += result > 0 ? result : 0;
+    }
+    bSaved = bSaved && fsync(set->journalFd) == 0;
+    free(line);
+
+    if (bSaved == false && written > 0 && (end < 0 || ftruncate(set->journalFd, end) < 0)) {
+        puts("Couldn't cut a failed update from the dictionary journal!");
+    }
+    return bSaved;
+}
+
+/* Adds or removes word in the dictionary with the given name. The path of the
+word is copied, the new root is published for readers to pick up on their
+next lookup, and the nodes it replaced are retired until no reader can be
+using them. Updates are serialized with each other but never block readers.
+If a journal is open, an update is only made once it has been saved there. */
+static DictionaryUpdate_t updateDictionarySet(DictionarySet_t * set, size_t reader, char * name, char * word, bool bAdd) {
+    Dictionary_t * dictionary = NULL;
+    for (size_t i = 0; i < set->numDictionaries; i++) {
+        if (strcmp(set->dictionaries[i].name, name) == 0) {
+            dictionary = &set->dictionaries[i];
+        }
+    }
+    if (dictionary == NULL) {
+        return DICTIONARY_UNKNOWN;
+    }
+
+    pthread_mutex_lock(&set->updateMutex);
+    Trie_t * oldTrie = atomic_load(&dictionary->trie);
+    Trie_t * newTrie = oldTrie;
+    Trie_t * oldRemoved = atomic_load(&dictionary->removed);
+    Trie_t * newRemoved = oldRemoved;
+    bool bBuiltin = dictionary->builtin != NULL && stringExistsInStaticTrie(dictionary->builtin, word);
+
+    //find out whether anything will change before saving the update
+    size_t numForms = 0;
+    size_t numInTrie = countStringFormsInTrie(oldTrie, word, &numForms);
+    size_t numRemoved = bBuiltin ? countStringFormsInTrie(oldRemoved, word, &numForms) : 0;
+    bool bChanges = bAdd ? (bBuiltin ? numRemoved > 0 : numInTrie < numForms)
+            : numInTrie > 0 || (bBuiltin && numRemoved < numForms);
+    if (bChanges == false) {
+        pthread_mutex_unlock(&set->updateMutex);
+        return DICTIONARY_UNCHANGED;
+    }
+    if (set->journalFd >= 0 && writeDictionaryJournal(set, bAdd, name, word) == false) {
+        pthread_mutex_unlock(&set->updateMutex);
+        return DICTIONARY_NOT_SAVED;
+    }
+
+    RetiredTrieNodes_t * retired = (RetiredTrieNodes_t *) calloc(1, sizeof (RetiredTrieNodes_t));
+    if (bAdd && bBuiltin) {
+        //a builtin word can only be added back after being removed
+        newRemoved = removeStringFromTrieCopy(oldRemoved, word, &retired->nodes);
+    } else if (bAdd) {
+        newTrie = insertStringToTrieCopy(oldTrie, word, &retired->nodes);
+    } else {
+        newTrie = removeStringFromTrieCopy(oldTrie, word, &retired->nodes);
+        if (bBuiltin) {
+            newRemoved = insertStringToTrieCopy(oldRemoved, word, &retired->nodes);
+        }
+    }
+    //readers entering after the epoch advances can only find the new tries
+    atomic_store(&dictionary->trie, newTrie);
+    atomic_store(&dictionary->removed, newRemoved);
+    retired->epoch = atomic_fetch_add(&set->epoch, 1) + 1;
+    retired->next = set->retired;
+    set->retired = retired;
+
+    if (bAdd) {
+        atomic_fetch_add(&dictionary->numWords, 1);
+    } else {
+        atomic_fetch_sub(&dictionary->numWords, 1);
+    }
+    atomic_fetch_add(&dictionary->memoryUsage, retired->nodes.memoryChange);
+
+    reclaimRetiredTrieNodes(set, reader);
+    pthread_mutex_unlock(&set->updateMutex);
+    return DICTIONARY_UPDATED;
+}
+
+/* Adds the null-terminated word to the named dictionary of the set while it
+may be being read, normalized in the same way as the words it was loaded
+with. reader is the index of the calling thread if it is a reader of the set,
+otherwise DICTIONARY_NO_READER. */
+DictionaryUpdate_t addWordToDictionarySet(DictionarySet_t * set, size_t reader, char * name, char * word) {
+    return updateDictionarySet(set, reader, name, word, true);
+}
+
+/* Removes the null-terminated word, and the variants of it which were added
+with it, from the named dictionary of the set while it may be being read.
+reader is as for addWordToDictionarySet. */
+DictionaryUpdate_t removeWordFromDictionarySet(DictionarySet_t * set, size_t reader, char * name, char * word) {
+    return updateDictionarySet(set, reader, name, word, false);
+}
+
+/* Replays the updates recorded in the journal file fileName, if it exists, to
+the set, then keeps appending every later update to it so they survive a
+restart. Each line of the journal is "add <dictionary> <word>" or
+"remove <dictionary> <word>". The number of updates replayed is stored in
+numReplayed; updates of dictionaries which are no longer loaded are skipped.
+Returns false if the journal could not be opened for
+appending. */
+bool openDictionaryJournal(DictionarySet_t * set, char * fileName, size_t * numReplayed) {
+    *numReplayed = 0;
+    FILE * fp = fopen(fileName, "r");
+    if (fp != NULL) {
+        char * line = NULL;
+        size_t capacity = 0;
+        ssize_t length = 0;
+        while ((length = getline(&line, &capacity, fp)) > 0) {
+            if (line[length - 1] == '\n') {
+                line[length - 1] = '\0';
+            }
+            char * savePtr = NULL;
+            char * operation = strtok_r(line, " ", &savePtr);
+            char * name = strtok_r(NULL, " ", &savePtr);
+            char * word = savePtr; //the rest of the line
+            if (operation == NULL || name == NULL || word == NULL || word[0] == '\0') {
+                continue;
+            }
+            DictionaryUpdate_t result = DICTIONARY_UNKNOWN;
+            if (strcmp(operation, "add") == 0) {
+                result = addWordToDictionarySet(set, DICTIONARY_NO_READER, name, word);
+            } else if (strcmp(operation, "remove") == 0) {
+                result = removeWordFromDictionarySet(set, DICTIONARY_NO_READER, name, word);
+            }
+            if (result != DICTIONARY_UNKNOWN) {
+                (*numReplayed)++;
+            }
+        }
+        free(line);
+        fclose(fp);
+    }
+
+    set->journalFd = open(fileName, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    return set->journalFd >= 0;
+}
+
+/* Returns the total of a lookup statistic of dictionary i over every reader
+of the set. */
+static size_t sumReaderCounts(DictionarySet_t * set, size_t i, bool bHits) {
+    size_t total = 0;
+    for (size_t r = 0; r < set->numReaders; r++) {
+        total += atomic_load_explicit(bHits ? &set->readers[r].hits[i] : &set->readers[r].lookups[i], memory_order_relaxed);
+    }
+    return total;
+}
+
+/* Returns a newly allocated string describing each dictionary in the set on
+it's own line: name, number of words, trie memory and lookup statistics. */
+char * getDictionarySetStats(DictionarySet_t * set) {
+    const size_t lineLength = 160;
+    char * stats = (char *) calloc(set->numDictionaries * lineLength + 1, 1);
+    size_t length = 0;
+    for (size_t i = 0; i < set->numDictionaries; i++) {
+        Dictionary_t * dictionary = &set->dictionaries[i];
+        length += snprintf(stats + length, lineLength, "%.32s words=%zu memory=%zu lookups=%zu hits=%zu\n",
+                dictionary->name, atomic_load(&dictionary->numWords), atomic_load(&dictionary->memoryUsage),
+                sumReaderCounts(set, i, false), sumReaderCounts(set, i, true));
+    }
+    return stats;
+}
+
+/* Test cases for the DictionarySet_t functions. */
+void testDictionarySet() {
+    FILE * words = fopen("testwords.txt", "w"); //a few words keep this quick, unlike the full list
+    assert(words != NULL);
+    fprintf(words, "guise\nhello\nworld\n");
+    fclose(words);
+
+    DictionarySet_t * set = newDictionarySet(2);
+    DictionaryMask_t selection = 0;
+
+    assert(loadDictionaryToSet(set, "en", "testwords.txt", TRIE_NORMALIZE_NONE) == true);
+    assert(loadDictionaryToSet(set, "ru", "words.ru", TRIE_NORMALIZE_NONE) == true);
+    assert(loadDictionaryToSet(set, "en", "words.ru", TRIE_NORMALIZE_NONE) == false);
+    assert(loadDictionaryToSet(set, "missing", "no-such-file", TRIE_NORMALIZE_NONE) == false);
+    assert(set->numDictionaries == 2);
+
+    assert(parseDictionarySelection(set, "ru", &selection) == true);
+    assert(selection == 2);
+    assert(parseDictionarySelection(set, "en,fr", &selection) == false);
+    assert(selection == 2);
+    assert(parseDictionarySelection(set, "en,ru", &selection) == true);
+    assert(selection == 3);
+
+    char * privet = "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82"; //привет
+    assert(stringExistsInDictionarySet(set, 0, 1, "hello") == true);
+    assert(stringExistsInDictionarySet(set, 0, 1, privet) == false);
+    assert(stringExistsInDictionarySet(set, 0, 2, privet) == true);
+    assert(stringExistsInDictionarySet(set, 0, 3, privet) == true);
+    assert(stringExistsInDictionarySet(set, 0, 3, "xyzzq") == false);
+
+    assert(stringExistsInDictionarySet(set, 1, 1, "hello") == true); //counted for another reader
+    assert(sumReaderCounts(set, 0, false) == 5);
+    assert(sumReaderCounts(set, 0, true) == 2);
+    assert(sumReaderCounts(set, 1, false) == 3);
+    assert(sumReaderCounts(set, 1, true) == 2);
+    assert(atomic_load(&set->readers[1].lookups[0]) == 1);
+    assert(set->dictionaries[1].numWords == 192);
+
+    char * stats = getDictionarySetStats(set);
+    assert(strncmp(stats, "en words=3 ", 11) == 0);
+    assert(strstr(stats, "\nru words=192 ") != NULL);
+    free(stats);
+
+    //nodes replaced while a reader is inside are kept until it leaves
+    enterDictionarySet(set, 0);
+    Trie_t * oldTrie = atomic_load(&set->dictionaries[0].trie);
+    assert(addWordToDictionarySet(set, 1, "en", "xyzzq") == DICTIONARY_UPDATED);
+    assert(addWordToDictionarySet(set, 1, "en", "xyzzq") == DICTIONARY_UNCHANGED);
+    assert(addWordToDictionarySet(set, 1, "fr", "xyzzq") == DICTIONARY_UNKNOWN);
+    assert(atomic_load(&set->dictionaries[0].trie) != oldTrie);
+    assert(stringExistsInTrie(oldTrie, "hello") == true);
+    assert(stringExistsInDictionarySet(set, 0, 1, "xyzzq") == true);
+    assert(set->dictionaries[0].numWords == 4);
+    assert(set->retired != NULL);
+    assert(set->dictionaries[0].memoryUsage == getTrieMemoryUsage(set->dictionaries[0].trie));
+    leaveDictionarySet(set, 0);
+    assert(removeWordFromDictionarySet(set, 1, "en", "hello") == DICTIONARY_UPDATED);
+    assert(set->retired == NULL); //no other reader is inside, so everything retired is freed
+    assert(stringExistsInDictionarySet(set, 0, 1, "hello") == false);
+    assert(removeWordFromDictionarySet(set, 1, "en", "hello") == DICTIONARY_UNCHANGED);
+    destroyDictionarySet(set);
+
+    //builtin dictionaries are used in place, with updates kept beside them
+    Trie_t * trie = newTrieFromDictionary("words.ru", TRIE_NORMALIZE_CAPITALIZED);
+    StaticTrie_t * builtin = flattenTrie(trie, 192);
+    destroyTrie(trie);
+    set = newDictionarySet(1);
+    assert(addBuiltinDictionaryToSet(set, "ru", builtin, NULL) == true);
+    assert(addBuiltinDictionaryToSet(set, "ru", builtin, NULL) == false);
+    assert(addBuiltinDictionaryToSet(set, "en", builtin, "no-such-file") == false);
+    assert(addBuiltinDictionaryToSet(set, "extra", builtin, "testwords.txt") == true);
+    assert(set->dictionaries[1].numWords == 192 + 3);
+    assert(addBuiltinDictionaryToSet(set, "again", builtin, "words.ru") == true); //nothing new
+    assert(set->dictionaries[2].numWords == 192);
+    assert(removeWordFromDictionarySet(set, 0, "again", privet) == DICTIONARY_UPDATED);
+    assert(set->dictionaries[2].numWords == 191);
+    assert(stringExistsInDictionarySet(set, 0, 1, privet) == true);
+    assert(stringExistsInDictionarySet(set, 0, 1, "hello") == false);
+    assert(stringExistsInDictionarySet(set, 0, 2, "hello") == true);
+    assert(stringExistsInDictionarySet(set, 0, 2, privet) == true);
+    assert(addWordToDictionarySet(set, 0, "ru", privet) == DICTIONARY_UNCHANGED);
+    assert(removeWordFromDictionarySet(set, 0, "ru", privet) == DICTIONARY_UPDATED);
+    assert(removeWordFromDictionarySet(set, 0, "ru", privet) == DICTIONARY_UNCHANGED);
+    assert(stringExistsInDictionarySet(set, 0, 1, privet) == false);
+    assert(stringExistsInDictionarySet(set, 0, 1, "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82") == false); //Привет
+    assert(stringExistsInDictionarySet(set, 0, 2, privet) == true);
+    assert(addWordToDictionarySet(set, 0, "ru", privet) == DICTIONARY_UPDATED);
+    assert(stringExistsInDictionarySet(set, 0, 1, privet) == true);
+    assert(addWordToDictionarySet(set, 0, "ru", "hello") == DICTIONARY_UPDATED);
+    assert(stringExistsInDictionarySet(set, 0, 1, "Hello") == true);
+    assert(set->dictionaries[0].numWords == 193);
+    destroyDictionarySet(set);
+    destroyFlattenedTrie(builtin);
+
+    //updates are journaled and replayed at startup
+    unlink("testjournal.txt");
+    size_t numReplayed = 0;
+    set = newDictionarySet(1);
+    assert(loadDictionaryToSet(set, "ru", "words.ru", TRIE_NORMALIZE_CAPITALIZED) == true);
+    assert(openDictionaryJournal(set, "testjournal.txt", &numReplayed) && numReplayed == 0);
+    assert(addWordToDictionarySet(set, 0, "ru", "hello world") == DICTIONARY_UPDATED);
+    assert(removeWordFromDictionarySet(set, 0, "ru", privet) == DICTIONARY_UPDATED);
+    assert(addWordToDictionarySet(set, 0, "ru", "hello world") == DICTIONARY_UNCHANGED);
+    assert(addWordToDictionarySet(set, 0, "en", "hello") == DICTIONARY_UNKNOWN);
+    destroyDictionarySet(set);
+    FILE * journal = fopen("testjournal.txt", "a");
+    fprintf(journal, "add en hello\n"); //a dictionary which is no longer loaded
+    fclose(journal);
+
+    set = newDictionarySet(1);
+    assert(loadDictionaryToSet(set, "ru", "words.ru", TRIE_NORMALIZE_CAPITALIZED) == true);
+    assert(openDictionaryJournal(set, "testjournal.txt", &numReplayed) && numReplayed == 2);
+    assert(stringExistsInDictionarySet(set, 0, 1, "Hello world") == true);
+    assert(stringExistsInDictionarySet(set, 0, 1, "HELLO WORLD") == true);
+    assert(stringExistsInDictionarySet(set, 0, 1, privet) == false);
+    assert(set->dictionaries[0].numWords == 192);
+    assert(set->dictionaries[0].memoryUsage == getTrieMemoryUsage(set->dictionaries[0].trie));
+
+    //an update which can't be saved isn't made
+    close(set->journalFd);
+    set->journalFd = open("/dev/full", O_WRONLY);
+    assert(set->journalFd >= 0);
+    assert(addWordToDictionarySet(set, 0, "ru", "xyzzq") == DICTIONARY_NOT_SAVED);
+    assert(stringExistsInDictionarySet(set, 0, 1, "xyzzq") == false);
+    assert(set->dictionaries[0].numWords == 192);
+    destroyDictionarySet(set);
+    unlink("testjournal.txt");
+    unlink("testwords.txt");
+}
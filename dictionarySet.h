@@ -0,0 +1,84 @@
+//See dictionarySet.c for function documentation.
+
+#ifndef DICTIONARYSET_H
+#define DICTIONARYSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "trie.h"
+
+#define MAX_DICTIONARIES 32
+#define DICTIONARY_NO_READER SIZE_MAX //for updates from a thread which is not a reader of the set
+#define DICTIONARY_READER_IDLE UINT64_MAX
+
+typedef uint32_t DictionaryMask_t; //bit i selects dictionary i of a set
+
+typedef struct Dictionary_s {
+    char * name;
+    Trie_t * _Atomic trie; //replaced whole when the dictionary is updated; for a builtin dictionary, the words added to it
+    const StaticTrie_t * builtin; //NULL unless the dictionary is compiled into the program
+    Trie_t * _Atomic removed; //words removed from the builtin dictionary, or NULL
+    atomic_size_t numWords;
+    atomic_size_t memoryUsage;
+} Dictionary_t;
+
+/* The state of a reader thread: the epoch it entered the set in, or
+DICTIONARY_READER_IDLE, and it's lookup statistics for each dictionary, which
+only it writes. Padded to whole cache lines so readers don't slow each other
+down. */
+typedef struct DictionaryReader_s {
+    atomic_uint_fast64_t epoch;
+    atomic_size_t lookups[MAX_DICTIONARIES]; //words checked against each dictionary
+    atomic_size_t hits[MAX_DICTIONARIES]; //words found in each dictionary
+    char padding[64 - sizeof (atomic_uint_fast64_t)];
+} DictionaryReader_t;
+
+/* Trie nodes replaced by an update, which are freed once every reader has
+entered the set since. */
+typedef struct RetiredTrieNodes_s {
+    TrieRetireList_t nodes;
+    uint64_t epoch; //the epoch of the set after the update
+    struct RetiredTrieNodes_s * next;
+} RetiredTrieNodes_t;
+
+typedef enum DictionaryUpdate_e {
+    DICTIONARY_UPDATED,
+    DICTIONARY_UNCHANGED, //the word was already there, or already not there
+    DICTIONARY_UNKNOWN, //no dictionary has that name
+    DICTIONARY_NOT_SAVED //the update could not be written to the journal, so it wasn't made
+} DictionaryUpdate_t;
+
+typedef struct DictionarySet_s {
+    Dictionary_t dictionaries[MAX_DICTIONARIES];
+    size_t numDictionaries;
+
+    //copy-on-write updates
+    pthread_mutex_t updateMutex;
+    atomic_uint_fast64_t epoch;
+    DictionaryReader_t * readers;
+    size_t numReaders;
+    RetiredTrieNodes_t * retired; //guarded by updateMutex
+    int journalFd; //-1 unless updates are being journaled
+} DictionarySet_t;
+
+DictionarySet_t * newDictionarySet(size_t numReaders);
+void destroyDictionarySet(DictionarySet_t * set);
+
+bool loadDictionaryToSet(DictionarySet_t * set, char * name, char * fileName, TrieNormalization_t normalization);
+bool addBuiltinDictionaryToSet(DictionarySet_t * set, char * name, const StaticTrie_t * builtin, char * overlayFileName);
+bool parseDictionarySelection(DictionarySet_t * set, char * names, DictionaryMask_t * selection);
+void enterDictionarySet(DictionarySet_t * set, size_t reader);
+void leaveDictionarySet(DictionarySet_t * set, size_t reader);
+bool stringExistsInDictionarySet(DictionarySet_t * set, size_t reader, DictionaryMask_t selection, char * string);
+DictionaryUpdate_t addWordToDictionarySet(DictionarySet_t * set, size_t reader, char * name, char * word);
+DictionaryUpdate_t removeWordFromDictionarySet(DictionarySet_t * set, size_t reader, char * name, char * word);
+bool openDictionaryJournal(DictionarySet_t * set, char * fileName, size_t * numReplayed);
+char * getDictionarySetStats(DictionarySet_t * set);
+
+void testDictionarySet();
+
+#endif /* DICTIONARYSET_H */
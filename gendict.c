@@ -0,0 +1,85 @@
+/* Generator for the builtin dictionary of spell. Builds a trie from a
+dictionary file, flattens it and writes it to stdout as C source defining
+staticDictionary, so spell can look words up in it straight from read-only
+program memory without loading or allocating anything. The Makefile runs it
+to produce staticDictionary.c. For example:
+
+    ./gendict words > staticDictionary.c
+    ./gendict -n capitalized words.ru > staticDictionary.c */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "trie.h"
+
+#define VALUES_PER_LINE 12
+
+/* Returns the number of lines in a dictionary file, which is the number of
+words it contains. */
+static size_t countLines(char * fileName) {
+    FILE * fp = fopen(fileName, "r");
+    size_t numLines = 0;
+    int c = 0;
+    while ((c = fgetc(fp)) != EOF) {
+        if (c == '\n') {
+            numLines++;
+        }
+    }
+    fclose(fp);
+    return numLines;
+}
+
+int main(int argc, char * argv[]) {
+    const char * usage = "Usage: gendict [-n <normalization list>] <dictionary file>";
+    TrieNormalization_t normalization = TRIE_NORMALIZE_NONE;
+    char * policyList = "none";
+    if (argc == 4 && strcmp(argv[1], "-n") == 0) {
+        policyList = argv[2];
+        if (parseTrieNormalization(policyList, &normalization) == false) {
+            fprintf(stderr, "%s\n", usage);
+            return EXIT_FAILURE;
+        }
+    } else if (argc != 2) {
+        fprintf(stderr, "%s\n", usage);
+        return EXIT_FAILURE;
+    }
+
+    char * fileName = argv[argc - 1];
+    Trie_t * tree = newTrieFromDictionary(fileName, normalization);
+    if (tree == NULL) {
+        fprintf(stderr, "Couldn't read dictionary %s\n", fileName);
+        return EXIT_FAILURE;
+    }
+    StaticTrie_t * trie = flattenTrie(tree, countLines(fileName));
+    destroyTrie(tree);
+
+    //the builtin dictionary is named after the file, without any directory
+    char * name = strrchr(fileName, '/') != NULL ? strrchr(fileName, '/') + 1 : fileName;
+
+    printf("/* Generated by gendict from %s with normalization %s. Do not edit;\n"
+            "it is rebuilt by make. */\n\n", fileName, policyList);
+    printf("#include \"staticDictionary.h\"\n\n");
+
+    printf("static const StaticTrieNode_t nodes[%zu] = {", trie->numNodes);
+    for (size_t i = 0; i < trie->numNodes; i++) {
+        printf("%s{%u,0x%x}%s", i % VALUES_PER_LINE == 0 ? "\n    " : "",
+                trie->nodes[i].firstChild, trie->nodes[i].numChildren, i + 1 < trie->numNodes ? "," : "");
+    }
+    printf("\n};\n\n");
+
+    printf("static const TrieValue_t values[%zu] = {", trie->numNodes);
+    for (size_t i = 0; i < trie->numNodes; i++) {
+        printf("%s0x%x%s", i % VALUES_PER_LINE == 0 ? "\n    " : "",
+                trie->values[i], i + 1 < trie->numNodes ? "," : "");
+    }
+    printf("\n};\n\n");
+
+    printf("const StaticTrie_t staticDictionary = { nodes, values, %zu, %zu, 0x%x };\n",
+            trie->numNodes, trie->numWords, (unsigned int) trie->normalization);
+    printf("const char staticDictionaryName[] = \"%s\";\n", name);
+    printf("const char staticDictionaryPath[] = \"%s\";\n", fileName);
+
+    destroyFlattenedTrie(trie);
+    return EXIT_SUCCESS;
+}
@@ -3,29 +3,160 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <time.h>
 #include "logger.h"
 
+/* Allocate a new LogEntry_t holding a copy of the first length bytes of word,
+timestamped with the current time. */
+LogEntry_t * newLogEntry(uint32_t connectionId, bool bCorrect, char * word, size_t length) {
+    LogEntry_t * entry = (LogEntry_t *) malloc(sizeof (LogEntry_t) + length + 1);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    entry->timestamp = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    entry->connectionId = connectionId;
+    entry->bCorrect = bCorrect;
+    memcpy(entry->word, word, length);
+    entry->word[length] = '\0';
+    return entry;
+}
+
+/* Allocate a Logger_t with every field cleared. */
+static Logger_t * allocLogger(LogFormat_t format) {
+    Logger_t * logger = malloc(sizeof(Logger_t));
+    memset(logger, 0, sizeof(Logger_t));
+    logger->format = format;
+    return logger;
+}
+
 /* Allocate a new Logger_t and return a pointer to it. The logger will record
 logged text to the file specified by fileName. If the file could not be opened,
 this function will return NULL. */
 Logger_t * newLogger(char * fileName) {
-    Logger_t * logger = malloc(sizeof(Logger_t));
+    Logger_t * logger = allocLogger(LOG_FORMAT_TEXT);
     logger->f = fopen(fileName, "w");
     if (logger->f == NULL) {
         destroyLogger(logger);
         return NULL;
-    } 
+    }
     return logger;
 }
 
-/* Deallocate the Logger_t data structure. */
+/* Allocate a new Logger_t which records log entries to the file specified by
+fileName as fixed size binary records, written a block at a time. Each
+distinct word is written once, to the file fileName with ".words" appended,
+and records refer to it by it's line number. If either file could not be
+opened, this function will return NULL. */
+Logger_t * newBinaryLogger(char * fileName) {
+    Logger_t * logger = allocLogger(LOG_FORMAT_BINARY);
+    char * wordsFileName = calloc(strlen(fileName) + 7, 1);
+    sprintf(wordsFileName, "%s.words", fileName);
+    logger->f = fopen(fileName, "wb");
+    logger->wordsFile = fopen(wordsFileName, "w");
+    free(wordsFileName);
+    if (logger->f == NULL || logger->wordsFile == NULL) {
+        destroyLogger(logger);
+        return NULL;
+    }
+
+    BinaryLogHeader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic));
+    header.version = BINARY_LOG_VERSION;
+    header.recordSize = sizeof(BinaryLogRecord_t);
+    fwrite(&header, sizeof(header), 1, logger->f);
+
+    logger->block = malloc(sizeof(BinaryLogRecord_t) * BINARY_LOG_BLOCK_RECORDS);
+    logger->wordTableCapacity = INITIAL_LOG_WORD_TABLE;
+    logger->wordTable = calloc(logger->wordTableCapacity, sizeof(char *));
+    logger->wordTableIds = calloc(logger->wordTableCapacity, sizeof(uint32_t));
+    logger->maxTableWords = MAX_LOG_WORD_TABLE_WORDS;
+    return logger;
+}
+
+/* Deallocate the Logger_t data structure, writing out anything it has
+buffered first. */
 void destroyLogger(Logger_t * logger) {
     if (logger->f != NULL) {
+        flushLogger(logger);
         fclose(logger->f);
     }
+    if (logger->wordsFile != NULL) {
+        fclose(logger->wordsFile);
+    }
+    for (size_t i = 0; i < logger->wordTableCapacity; i++) {
+        free(logger->wordTable[i]);
+    }
+    free(logger->wordTable);
+    free(logger->wordTableIds);
+    free(logger->block);
     free(logger);
 }
 
+/* Returns the FNV-1a hash of a null-terminated string. */
+static uint64_t hashWord(char * word) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; word[i] != '\0'; i++) {
+        hash ^= (unsigned char) word[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Returns the slot of the word table holding word, or the empty slot where
+it belongs. */
+static size_t findWordSlot(Logger_t * logger, char * word) {
+    size_t slot = hashWord(word) & (logger->wordTableCapacity - 1);
+    while (logger->wordTable[slot] != NULL && strcmp(logger->wordTable[slot], word) != 0) {
+        slot = (slot + 1) & (logger->wordTableCapacity - 1);
+    }
+    return slot;
+}
+
+/* Returns the id of word in a binary logger, interning it and writing it to
+the words file the first time it is seen. Once the table holds maxTableWords
+words, words which are not in it are written to the words file each time they
+are logged instead, so clients sending endless distinct words can't grow the
+server's memory without bound. Once every id below BINARY_LOG_UNKNOWN_WORD
+has been used, new words are logged as BINARY_LOG_UNKNOWN_WORD. */
+static uint32_t internWord(Logger_t * logger, char * word) {
+    size_t slot = findWordSlot(logger, word);
+    if (logger->wordTable[slot] != NULL) {
+        return logger->wordTableIds[slot];
+    }
+    if (logger->numWords == BINARY_LOG_UNKNOWN_WORD) {
+        return BINARY_LOG_UNKNOWN_WORD;
+    }
+
+    fprintf(logger->wordsFile, "%s\n", word);
+    if (logger->numTableWords == logger->maxTableWords) {
+        return logger->numWords++;
+    }
+    logger->wordTable[slot] = strdup(word);
+    logger->wordTableIds[slot] = logger->numWords;
+    logger->numTableWords++;
+
+    //keep the table at most half full, rehashing into one twice the size
+    if (logger->numTableWords * 2 > logger->wordTableCapacity) {
+        char ** oldTable = logger->wordTable;
+        uint32_t * oldIds = logger->wordTableIds;
+        size_t oldCapacity = logger->wordTableCapacity;
+        logger->wordTableCapacity *= 2;
+        logger->wordTable = calloc(logger->wordTableCapacity, sizeof(char *));
+        logger->wordTableIds = calloc(logger->wordTableCapacity, sizeof(uint32_t));
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldTable[i] != NULL) {
+                size_t newSlot = findWordSlot(logger, oldTable[i]);
+                logger->wordTable[newSlot] = oldTable[i];
+                logger->wordTableIds[newSlot] = oldIds[i];
+            }
+        }
+        free(oldTable);
+        free(oldIds);
+    }
+
+    return logger->numWords++;
+}
+
 /* Write a string to the Logger_t specified by logger. The string provided must
 be NULL terminated. */
 bool logText(Logger_t * logger, char * string) {
@@ -33,9 +164,37 @@ bool logText(Logger_t * logger, char * string) {
     return true; //pointless
 }
 
+/* Record the result of a spell check to the Logger_t specified by logger,
+either as a "<word> OK" line or as a binary record, depending on the format of
+the logger. */
+bool logEntry(Logger_t * logger, LogEntry_t * entry) {
+    if (logger->format == LOG_FORMAT_TEXT) {
+        fprintf(logger->f, "%s %s\n", entry->word, entry->bCorrect ? "OK" : "MISSPELLED");
+        return true;
+    }
+
+    BinaryLogRecord_t * record = &logger->block[logger->blockRecords];
+    record->timestamp = entry->timestamp;
+    record->connectionId = entry->connectionId;
+    record->word = internWord(logger, entry->word) | (entry->bCorrect ? BINARY_LOG_OK_BIT : 0);
+    logger->blockRecords++;
+    if (logger->blockRecords == BINARY_LOG_BLOCK_RECORDS) {
+        fwrite(logger->block, sizeof(BinaryLogRecord_t), logger->blockRecords, logger->f);
+        logger->blockRecords = 0;
+    }
+    return true;
+}
+
 /* Flush the logger's output buffer. This ensures that any pending writes are
 flushed to the disk. */
 void flushLogger(Logger_t * logger) {
+    if (logger->blockRecords > 0) {
+        fwrite(logger->block, sizeof(BinaryLogRecord_t), logger->blockRecords, logger->f);
+        logger->blockRecords = 0;
+    }
+    if (logger->wordsFile != NULL) {
+        fflush(logger->wordsFile);
+    }
     fflush(logger->f);
 }
 
@@ -48,4 +207,65 @@ void testLogger() {
     logText(testLogger, str);
     flushLogger(testLogger);
     destroyLogger(testLogger);
+    free(str);
+
+    //enough entries to span a block and grow the word table
+    const uint32_t numEntries = BINARY_LOG_BLOCK_RECORDS + 10;
+    testLogger = newBinaryLogger("testlog.bin");
+    assert(testLogger != NULL);
+    for (uint32_t i = 0; i < numEntries; i++) {
+        char word[16];
+        sprintf(word, "w%u", i % 3000);
+        LogEntry_t * entry = newLogEntry(i % 7, i % 2 == 0, word, strlen(word));
+        logEntry(testLogger, entry);
+        free(entry);
+    }
+    destroyLogger(testLogger);
+
+    FILE * f = fopen("testlog.bin", "rb");
+    BinaryLogHeader_t header;
+    BinaryLogRecord_t record;
+    assert(fread(&header, sizeof(header), 1, f) == 1);
+    assert(memcmp(header.magic, BINARY_LOG_MAGIC, 8) == 0);
+    assert(header.recordSize == sizeof(BinaryLogRecord_t));
+    for (uint32_t i = 0; i < numEntries; i++) {
+        assert(fread(&record, sizeof(record), 1, f) == 1);
+        assert(record.connectionId == i % 7);
+        assert((record.word & ~BINARY_LOG_OK_BIT) == i % 3000);
+        assert(((record.word & BINARY_LOG_OK_BIT) != 0) == (i % 2 == 0));
+    }
+    assert(fread(&record, sizeof(record), 1, f) == 0);
+    fclose(f);
+
+    f = fopen("testlog.bin.words", "r");
+    char line[16];
+    size_t numLines = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        numLines++;
+    }
+    assert(numLines == 3000);
+    fclose(f);
+
+    //words beyond a full table are written again each time they are logged
+    testLogger = newBinaryLogger("testlog.bin");
+    testLogger->maxTableWords = 2;
+    char * words[] = {"a", "b", "a", "c", "c", "b"};
+    for (size_t i = 0; i < 6; i++) {
+        LogEntry_t * entry = newLogEntry(0, true, words[i], 1);
+        logEntry(testLogger, entry);
+        free(entry);
+    }
+    assert(testLogger->numTableWords == 2);
+    assert(testLogger->numWords == 4);
+
+    //ids never reach the result bit
+    testLogger->numWords = BINARY_LOG_UNKNOWN_WORD - 1;
+    for (size_t i = 0; i < 2; i++) {
+        LogEntry_t * entry = newLogEntry(0, false, "d", 1);
+        logEntry(testLogger, entry);
+        free(entry);
+    }
+    assert(testLogger->block[testLogger->blockRecords - 2].word == BINARY_LOG_UNKNOWN_WORD - 1);
+    assert(testLogger->block[testLogger->blockRecords - 1].word == BINARY_LOG_UNKNOWN_WORD);
+    destroyLogger(testLogger);
 }
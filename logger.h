@@ -4,18 +4,72 @@
 #define EVENTLOGGER_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+#define BINARY_LOG_MAGIC "SPELLLOG"
+#define BINARY_LOG_VERSION 1
+#define BINARY_LOG_OK_BIT 0x80000000u //set in BinaryLogRecord_t.word when the word was spelled correctly
+#define BINARY_LOG_UNKNOWN_WORD (BINARY_LOG_OK_BIT - 1) //the id of words logged after every other id was used
+#define BINARY_LOG_BLOCK_RECORDS 4096 //records buffered before each write
+#define INITIAL_LOG_WORD_TABLE 4096
+#define MAX_LOG_WORD_TABLE_WORDS (1 << 20) //distinct words kept in memory before new ones are written every time
+
+typedef enum LogFormat_e {
+    LOG_FORMAT_TEXT, //"<word> OK" lines
+    LOG_FORMAT_BINARY //fixed size records, with words interned in a companion file
+} LogFormat_t;
+
+/* The result of a single spell check, as passed from a worker to the log. */
+typedef struct LogEntry_s {
+    uint64_t timestamp; //nanoseconds since the Unix epoch
+    uint32_t connectionId;
+    bool bCorrect;
+    char word[]; //null terminated
+} LogEntry_t;
+
+/* The header at the start of a binary log file. */
+typedef struct BinaryLogHeader_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+} BinaryLogHeader_t;
+
+/* A single record in a binary log file. Words are replaced by their line
+number in the words file written alongside the log (<log file>.words). A word
+may be on several lines, and so have several ids, if the logger's word table
+was full when it was logged. */
+typedef struct BinaryLogRecord_s {
+    uint64_t timestamp;
+    uint32_t connectionId;
+    uint32_t word; //interned word id, with BINARY_LOG_OK_BIT set if it was correct
+} BinaryLogRecord_t;
+
 typedef struct Logger_s {
     FILE *f;
+    LogFormat_t format;
+
+    //only used by binary loggers
+    FILE * wordsFile;
+    BinaryLogRecord_t * block;
+    size_t blockRecords;
+    char ** wordTable; //open addressing hash table of interned words
+    uint32_t * wordTableIds;
+    size_t wordTableCapacity;
+    size_t numTableWords;
+    size_t maxTableWords;
+    uint32_t numWords; //lines written to the words file
 } Logger_t;
 
+LogEntry_t * newLogEntry(uint32_t connectionId, bool bCorrect, char * word, size_t length);
+
 Logger_t * newLogger(char * fileName);
+Logger_t * newBinaryLogger(char * fileName);
 void destroyLogger(Logger_t * logger);
 bool logText(Logger_t * logger, char * string);
+bool logEntry(Logger_t * logger, LogEntry_t * entry);
 void flushLogger(Logger_t * logger);
 
 void testLogger();
 
 #endif /* EVENTLOGGER_H */
-
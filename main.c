@@ -1,19 +1,58 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "trie.h"
+#include "dictionarySet.h"
 #include "sck.h"
 #include "threadsafeQueue.h"
+#include "scheduler.h"
+#include "trace.h"
 #include "logger.h"
+#include "staticDictionary.h"
+
+#define BUILTIN_DICTIONARY_FILE ":builtin" //the file name which selects the builtin dictionary
+
+/* What a worker does with a log entry when the log queue is full. */
+enum LogOverflowPolicy_e {
+    LOG_OVERFLOW_BLOCK, //wait for the log thread to make space
+    LOG_OVERFLOW_DROP, //discard the entry and count it
+    LOG_OVERFLOW_SPILL //append the entry to the spill file instead
+};
+
+/* Which clients may change the dictionaries with !add and !remove. */
+enum AdminPolicy_e {
+    ADMIN_LOCAL, //only clients of the Unix domain socket, which file permissions protect
+    ADMIN_ALL,
+    ADMIN_NONE
+};
 
 struct Configuration_s {
     uint16_t port;
-    char * dictionaryFileName;
+    char * localSocketPath; //NULL unless also listening on a Unix domain socket
+    char * dictionaryNames[MAX_DICTIONARIES];
+    char * dictionaryFileNames[MAX_DICTIONARIES];
+    int numDictionaries;
     int numWorkers;
+    int maxPendingConnections;
+    enum LogOverflowPolicy_e logOverflowPolicy;
+    TrieNormalization_t normalization;
+    int shutdownGraceSeconds;
+    LogFormat_t logFormat;
+    unsigned int traceSampleRate;
+    char * journalFileName; //NULL unless dictionary updates are journaled
+    char * overlayFileName; //words added to the builtin dictionary, or NULL
+    enum AdminPolicy_e adminPolicy;
     bool bGoodConf;
 };
 
@@ -22,14 +61,27 @@ the arguments provided to the function (argc and argv from main).
 The returned struct will have bGoodConf set to true if the configuration
 parameters provided are valid, false otherwise. */
 struct Configuration_s setConfiguration(int argc, char * argv[]) {
-    static const char * defaultDict = "words"; //keep it in static program memory
+    static const char * defaultDict = BUILTIN_DICTIONARY_FILE; //keep it in static program memory
     const uint16_t defaultPort = 2667;
     const int defaultNumWorkers = 4;
+    const int defaultShutdownGraceSeconds = 5;
     struct Configuration_s conf;
 
     conf.port = defaultPort;
-    conf.dictionaryFileName = (char *) defaultDict;
+    conf.dictionaryNames[0] = (char *) staticDictionaryName;
+    conf.dictionaryFileNames[0] = (char *) defaultDict;
+    conf.numDictionaries = 0;
     conf.numWorkers = defaultNumWorkers;
+    conf.maxPendingConnections = 0; //same as the number of workers
+    conf.logOverflowPolicy = LOG_OVERFLOW_BLOCK;
+    conf.logFormat = LOG_FORMAT_TEXT;
+    conf.normalization = TRIE_NORMALIZE_NONE;
+    conf.shutdownGraceSeconds = defaultShutdownGraceSeconds;
+    conf.traceSampleRate = DEFAULT_TRACE_SAMPLE_RATE;
+    conf.localSocketPath = NULL;
+    conf.journalFileName = NULL;
+    conf.overlayFileName = NULL;
+    conf.adminPolicy = ADMIN_LOCAL;
     conf.bGoodConf = true;
 
     for (size_t i = 1; i < argc; i += 2) {
@@ -38,15 +90,20 @@ struct Configuration_s setConfiguration(int argc, char * argv[]) {
              but it should be available throughout the life of the 
              program because it doesn't go out of scope until
              main() dies. */
-            if (i + 1 >= argc) {
+            if (i + 1 >= argc || conf.numDictionaries == MAX_DICTIONARIES) {
                 conf.bGoodConf = false;
                 return conf;
             }
 
-            conf.dictionaryFileName = argv[i + 1];
-            if (conf.dictionaryFileName == NULL) {
-                conf.dictionaryFileName = (char *) defaultDict;
+            //either "name=file", or just "file" which is also used as the name
+            char * equals = strchr(argv[i + 1], '=');
+            conf.dictionaryNames[conf.numDictionaries] = argv[i + 1];
+            conf.dictionaryFileNames[conf.numDictionaries] = argv[i + 1];
+            if (equals != NULL) {
+                *equals = '\0';
+                conf.dictionaryFileNames[conf.numDictionaries] = equals + 1;
             }
+            conf.numDictionaries++;
         } else if (strcmp(argv[i], "-t") == 0) {
             if (i + 1 >= argc) {
                 conf.bGoodConf = false;
@@ -67,91 +124,576 @@ struct Configuration_s setConfiguration(int argc, char * argv[]) {
             if (conf.port < 1) {
                 conf.port = defaultPort;
             }
+        } else if (strcmp(argv[i], "-q") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            conf.maxPendingConnections = (int) strtol(argv[i + 1], NULL, 10);
+            if (conf.maxPendingConnections < 1) {
+                conf.maxPendingConnections = 0;
+            }
+        } else if (strcmp(argv[i], "-l") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            if (strcmp(argv[i + 1], "block") == 0) {
+                conf.logOverflowPolicy = LOG_OVERFLOW_BLOCK;
+            } else if (strcmp(argv[i + 1], "drop") == 0) {
+                conf.logOverflowPolicy = LOG_OVERFLOW_DROP;
+            } else if (strcmp(argv[i + 1], "spill") == 0) {
+                conf.logOverflowPolicy = LOG_OVERFLOW_SPILL;
+            } else {
+                conf.bGoodConf = false;
+                return conf;
+            }
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            if (strcmp(argv[i + 1], "text") == 0) {
+                conf.logFormat = LOG_FORMAT_TEXT;
+            } else if (strcmp(argv[i + 1], "binary") == 0) {
+                conf.logFormat = LOG_FORMAT_BINARY;
+            } else {
+                conf.bGoodConf = false;
+                return conf;
+            }
+        } else if (strcmp(argv[i], "-g") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            conf.shutdownGraceSeconds = (int) strtol(argv[i + 1], NULL, 10);
+            if (conf.shutdownGraceSeconds < 0) {
+                conf.shutdownGraceSeconds = defaultShutdownGraceSeconds;
+            }
+        } else if (strcmp(argv[i], "-u") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            conf.localSocketPath = argv[i + 1];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            conf.journalFileName = argv[i + 1];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            if (strcmp(argv[i + 1], "local") == 0) {
+                conf.adminPolicy = ADMIN_LOCAL;
+            } else if (strcmp(argv[i + 1], "all") == 0) {
+                conf.adminPolicy = ADMIN_ALL;
+            } else if (strcmp(argv[i + 1], "none") == 0) {
+                conf.adminPolicy = ADMIN_NONE;
+            } else {
+                conf.bGoodConf = false;
+                return conf;
+            }
+        } else if (strcmp(argv[i], "-s") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            conf.traceSampleRate = (unsigned int) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc) {
+                conf.bGoodConf = false;
+                return conf;
+            }
+
+            conf.overlayFileName = argv[i + 1];
+        } else if (strcmp(argv[i], "-n") == 0) {
+            if (i + 1 >= argc || parseTrieNormalization(argv[i + 1], &conf.normalization) == false) {
+                conf.bGoodConf = false;
+                return conf;
+            }
         } else {
             conf.bGoodConf = false;
         }
     }
 
+    if (conf.numDictionaries == 0) {
+        conf.numDictionaries = 1; //the default dictionary
+
+        //the builtin dictionary can't be renormalized, but the file it was made from can
+        if (conf.normalization != staticDictionary.normalization) {
+            conf.dictionaryFileNames[0] = (char *) staticDictionaryPath;
+        }
+    }
+
+    int numBuiltinDictionaries = 0;
+    for (int i = 0; i < conf.numDictionaries; i++) {
+        if (strcmp(conf.dictionaryFileNames[i], BUILTIN_DICTIONARY_FILE) == 0) {
+            numBuiltinDictionaries++;
+        }
+    }
+    if (numBuiltinDictionaries > 0 && conf.normalization != staticDictionary.normalization) {
+        puts("The builtin dictionary was built with other normalization policies than -n gives.");
+        conf.bGoodConf = false;
+    }
+    if (conf.overlayFileName != NULL && numBuiltinDictionaries != 1) {
+        puts("-o needs exactly one -d with the builtin dictionary.");
+        conf.bGoodConf = false;
+    }
+    if (conf.maxPendingConnections == 0) {
+        conf.maxPendingConnections = conf.numWorkers;
+    }
+
     if (conf.bGoodConf) {
-        printf("Using dictionary %s\n", conf.dictionaryFileName);
+        for (int i = 0; i < conf.numDictionaries; i++) {
+            printf("Using dictionary %s from %s\n", conf.dictionaryNames[i], conf.dictionaryFileNames[i]);
+        }
         printf("Starting %d worker threads\n", conf.numWorkers);
+        printf("Allowing at most %d connections\n", conf.numWorkers + conf.maxPendingConnections);
         printf("Listening on port %d\n", (int) conf.port);
+        if (conf.localSocketPath != NULL) {
+            printf("Listening on Unix domain socket %s\n", conf.localSocketPath);
+        }
     }
 
     return conf;
 }
 
+/* Counters describing how the server is coping with it's load. */
+struct ServerMetrics_s {
+    atomic_size_t acceptedConnections; //also the source of connection ids
+    atomic_size_t rejectedConnections; //turned away because too many were open
+    atomic_size_t openConnections;
+    atomic_size_t batches; //connection batches served by workers
+    atomic_size_t logBlocked; //log entries which had to wait for space on the log queue
+    atomic_size_t logDropped;
+    atomic_size_t logSpilled;
+};
+
+/* A connected client. A connection is either armed in the poller waiting for
+it's socket to become readable, or owned by exactly one worker as a task on
+the scheduler, so it's socket and state are never shared. */
+struct Connection_s {
+    NetSocket_t * socket;
+    uint32_t id;
+    DictionaryMask_t selection;
+    uint64_t lastActivityMs; //when the client last sent anything
+    bool bClosing; //set by the worker handing it back when it should be closed
+    bool bScheduled; //only used by the poller
+    size_t pollerIndex; //only used by the poller
+};
+
 struct ThreadParams_s {
-    ThreadsafeQueue_t * socketQueue;
+    Scheduler_t * scheduler;
+    ThreadsafeQueue_t * returnQueue; //connections handed back to the poller by workers
+    int wakeFd; //eventfd which wakes the poller when a connection is handed back
     ThreadsafeQueue_t * logQueue;
-    Trie_t * dictionary;
+    DictionarySet_t * dictionaries;
+    struct ServerMetrics_s * metrics;
+    size_t maxConnections;
+    enum AdminPolicy_e adminPolicy;
+    LogFormat_t logFormat;
+    enum LogOverflowPolicy_e logOverflowPolicy;
+    Logger_t * spillLogger; //only used with LOG_OVERFLOW_SPILL
+    pthread_mutex_t * spillMutex;
 };
 
-/* Worker function that interacts with a single connected client and handles any
-spell checking requests. */
-void * spellWorker(void * param) {
-    struct ThreadParams_s params = *((struct ThreadParams_s *) param);
+/* Returns a monotonic timestamp in milliseconds. */
+static uint64_t nowMilliseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Returns a newly allocated line describing the server metrics and the
+current depth of it's queues. */
+static char * getServerStats(struct ThreadParams_s * params) {
+    char * stats = (char *) calloc(320, 1);
+    snprintf(stats, 320, "server accepted=%zu rejected=%zu connections=%zu/%zu batches=%zu "
+            "queued_batches=%zu steals=%zu log_queue=%zu/%zu log_blocked=%zu log_dropped=%zu log_spilled=%zu\n",
+            atomic_load(&params->metrics->acceptedConnections),
+            atomic_load(&params->metrics->rejectedConnections),
+            atomic_load(&params->metrics->openConnections), params->maxConnections,
+            atomic_load(&params->metrics->batches),
+            atomic_load(&params->scheduler->pendingTasks),
+            atomic_load(&params->scheduler->steals),
+            getThreadsafeQueueItems(params->logQueue), params->logQueue->capacity,
+            atomic_load(&params->metrics->logBlocked),
+            atomic_load(&params->metrics->logDropped),
+            atomic_load(&params->metrics->logSpilled));
+    return stats;
+}
+
+/* Hands a malloc'd log entry to the log thread. If the log queue is full, the
+configured overflow policy decides whether to wait for it, drop the entry or
+spill it to a file, so that a slow log can't stall every worker unless asked
+to. */
+static void submitLogEntry(struct ThreadParams_s * params, LogEntry_t * entry) {
+    if (tryPushThreadsafeQueue(params->logQueue, entry)) {
+        return;
+    }
+
+    switch (params->logOverflowPolicy) {
+        case LOG_OVERFLOW_DROP:
+            atomic_fetch_add(&params->metrics->logDropped, 1);
+            free(entry);
+            break;
+        case LOG_OVERFLOW_SPILL:
+            pthread_mutex_lock(params->spillMutex);
+            logEntry(params->spillLogger, entry);
+            pthread_mutex_unlock(params->spillMutex);
+            atomic_fetch_add(&params->metrics->logSpilled, 1);
+            free(entry);
+            break;
+        default:
+            atomic_fetch_add(&params->metrics->logBlocked, 1);
+            if (pushThreadsafeQueue(params->logQueue, entry) == false) {
+                free(entry);
+            }
+            break;
+    }
+}
 
-    //get a socket from a queue
-    NetSocket_t * client = (NetSocket_t *) popThreadsafeQueue(params.socketQueue);
-
-    while (1) {
-        //read from socket and spellcheck
-        SocketPayload_t * payload = readLineNetSocket(client); //readNetSocket(client, 255);
-        if (payload != NULL) {
-            if (payload->size > 0) {
-
-                /* Need to malloc a new string to pass to log thread
-                 Otherwise we have a race to free() in destroySocketPayload() */
-                char * logStr = (char *) calloc(payload->size + 16, 1);
-                char * responseStr = (char *) calloc(payload->size + 16, 1);
-                if (stringExistsInTrie(params.dictionary, payload->data)) {
-                    sprintf(logStr, "%s OK", payload->data);
-                    sprintf(responseStr, "%s OK\n", payload->data);
-                } else {
-                    sprintf(logStr, "%s MISSPELLED", payload->data);
-                    sprintf(responseStr, "%s MISSPELLED\n", payload->data);
-                }
-                writeNetSocket(client, responseStr, strlen(responseStr));
-                pushThreadsafeQueue(params.logQueue, logStr);
-
-                free(responseStr);
-            }
-        }
-
-        //if client disconnects, get another socket (client).
-        if (payload == NULL) {
-            puts("Client disconnected, waiting for a new one...");
-            destroyNetSocket(client);
-            client = (NetSocket_t *) popThreadsafeQueue(params.socketQueue);
+/* Handles a command line sent by a client, which begins with '!' rather than
+being a word to check. Commands are:
+    !dict <name>[,<name>...] : check following words against the union of the
+                               named dictionaries
+    !stats                   : report memory and hit statistics per dictionary,
+                               and the server's load metrics
+    !add <name> <word>       : add a word to the named dictionary
+    !remove <name> <word>    : remove a word from the named dictionary
+Responses to commands also begin with '!' so clients can tell them apart from
+spell checking results. */
+static void handleCommand(struct ThreadParams_s * params, NetSocket_t * client, char * command,
+        DictionaryMask_t * selection, size_t reader) {
+    char * response = NULL;
+    bool bAdd = strncmp(command, "!add ", 5) == 0;
+
+    if (bAdd || strncmp(command, "!remove ", 8) == 0) {
+        const char * name = bAdd ? "!add" : "!remove";
+        char * dictionary = command + strlen(name) + 1;
+        char * word = strchr(dictionary, ' ');
+        response = (char *) calloc(64, 1);
+        if (params->adminPolicy == ADMIN_NONE || (params->adminPolicy == ADMIN_LOCAL && client->bLocal == false)) {
+            sprintf(response, "%s ERROR not permitted\n", name);
+        } else if (word == NULL || word[1] == '\0') {
+            sprintf(response, "%s ERROR usage: %s <dictionary> <word>\n", name, name);
+        } else {
+            *word++ = '\0';
+            DictionaryUpdate_t result = bAdd ? addWordToDictionarySet(params->dictionaries, reader, dictionary, word)
+                    : removeWordFromDictionarySet(params->dictionaries, reader, dictionary, word);
+            if (result == DICTIONARY_UPDATED) {
+                sprintf(response, "%s OK\n", name);
+            } else if (result == DICTIONARY_UNCHANGED) {
+                sprintf(response, "%s UNCHANGED\n", name);
+            } else if (result == DICTIONARY_NOT_SAVED) {
+                sprintf(response, "%s ERROR not saved\n", name);
+            } else {
+                sprintf(response, "%s ERROR unknown dictionary\n", name);
+            }
+        }
+    } else if (strncmp(command, "!dict ", 6) == 0) {
+        if (parseDictionarySelection(params->dictionaries, command + 6, selection)) {
+            response = strdup("!dict OK\n");
         } else {
-            destroySocketPayload(payload);
+            response = strdup("!dict ERROR unknown dictionary\n");
+        }
+    } else if (strcmp(command, "!stats") == 0) {
+        char * stats = getDictionarySetStats(params->dictionaries);
+        response = (char *) calloc(strlen(stats) * 2 + 16, 1);
+        size_t length = 0;
+        char * savePtr = NULL;
+        for (char * line = strtok_r(stats, "\n", &savePtr); line != NULL; line = strtok_r(NULL, "\n", &savePtr)) {
+            length += sprintf(response + length, "!stats %s\n", line);
+        }
+        free(stats);
+
+        stats = getServerStats(params);
+        response = (char *) realloc(response, length + strlen(stats) + 32);
+        length += sprintf(response + length, "!stats %s", stats);
+        strcpy(response + length, "!stats END\n");
+        free(stats);
+    } else {
+        response = strdup("!ERROR unknown command\n");
+    }
+
+    writeNetSocket(client, response, strlen(response));
+    free(response);
+}
+
+/* Set from the SIGTERM/SIGINT handler to stop accepting connections, and by
+main() once the shutdown deadline has passed. */
+static volatile sig_atomic_t bShutdownRequested = 0;
+static volatile sig_atomic_t bShutdownDeadlinePassed = 0;
+
+/* Signal handler for SIGTERM and SIGINT which begins a graceful shutdown. */
+static void requestShutdown(int signalNumber) {
+    bShutdownRequested = 1;
+}
+
+/* Per-thread parameters of a spellWorker. */
+struct WorkerParams_s {
+    struct ThreadParams_s * shared;
+    size_t index; //which of the scheduler's deques belongs to this worker
+};
+
+#define CLIENT_WRITE_TIMEOUT_MS 10000 //a client which reads none of it's responses for this long is disconnected
+#define MAX_RESPONSE_IOVECS 512 //two per word, well under IOV_MAX
+#define MAX_BATCH_LINES (MAX_RESPONSE_IOVECS / 2)
+
+/* Serves one batch of a connection: receives whatever the client has sent if
+no complete line is already buffered, then handles up to MAX_BATCH_LINES
+lines. Every line is checked in place in the socket's receive buffer, and the
+responses are sent back together as one gathered write of the original words
+and static suffixes, so no response is formatted or allocated. Returns false
+once the client has disconnected and everything it sent has been answered, or
+once it has stopped reading it's responses. */
+static bool serveConnectionBatch(struct ThreadParams_s * params, struct Connection_s * connection, size_t reader) {
+    static const char okSuffix[] = " OK\n";
+    static const char misspelledSuffix[] = " MISSPELLED\n";
+    NetSocket_t * client = connection->socket;
+    struct iovec responses[MAX_RESPONSE_IOVECS];
+    int numResponses = 0;
+
+    TRACE_BATCH(connection->id);
+    if (hasLineNetSocket(client) == false) {
+        TRACE_START(receiveStart);
+        ssize_t received = receiveNetSocket(client);
+        TRACE_STOP(TRACE_RECEIVE, receiveStart);
+        if (received < 0) {
+            //a spurious wake up leaves nothing to read, anything else is fatal
+            return client->errorNumber == EAGAIN || client->errorNumber == EWOULDBLOCK;
+        }
+        connection->lastActivityMs = nowMilliseconds();
+    }
+
+    char * word = NULL;
+    size_t length = 0;
+    for (int lines = 0; lines < MAX_BATCH_LINES && (word = nextLineNetSocket(client, &length)) != NULL; lines++) {
+        if (word[0] == '!') {
+            //answer everything before the command first to keep responses in order
+            writevNetSocket(client, responses, numResponses);
+            numResponses = 0;
+            handleCommand(params, client, word, &connection->selection, reader);
+            continue;
+        } else if (length == 0) {
+            continue;
+        }
+
+        TRACE_START(lookupStart);
+        bool bFound = stringExistsInDictionarySet(params->dictionaries, reader, connection->selection, word);
+        TRACE_STOP(TRACE_LOOKUP, lookupStart);
+
+        TRACE_START(formatStart);
+        responses[numResponses].iov_base = word;
+        responses[numResponses].iov_len = length;
+        responses[numResponses + 1].iov_base = (void *) (bFound ? okSuffix : misspelledSuffix);
+        responses[numResponses + 1].iov_len = bFound ? sizeof (okSuffix) - 1 : sizeof (misspelledSuffix) - 1;
+        numResponses += 2;
+        TRACE_STOP(TRACE_FORMAT, formatStart);
+
+        //the log thread outlives the receive buffer, so it needs a copy
+        TRACE_START(logPushStart);
+        submitLogEntry(params, newLogEntry(connection->id, bFound, word, length));
+        TRACE_STOP(TRACE_LOG_PUSH, logPushStart);
+    }
+    TRACE_START(writeStart);
+    writevNetSocket(client, responses, numResponses);
+    TRACE_STOP(TRACE_WRITE, writeStart);
+
+    if (client->errorNumber == ETIMEDOUT) {
+        return false;
+    }
+    return client->bReceiveClosed == false || hasLineNetSocket(client);
+}
+
+/* Hands a connection a worker has finished with back to the poller, which
+either waits for the client to send more or closes it. */
+static void returnConnection(struct ThreadParams_s * params, struct Connection_s * connection) {
+    uint64_t one = 1;
+    pushThreadsafeQueue(params->returnQueue, connection);
+    if (write(params->wakeFd, &one, sizeof (one)) < 0) {
+        puts("Couldn't wake the poller!");
+    }
+}
+
+/* Worker function that serves batches of whichever connections have requests
+waiting. A connection is only held for one batch at a time, so a client
+sending a lot of words shares the workers fairly with the others, and idle
+workers steal batches from busy ones. Returns once the scheduler has been
+closed and drained. */
+void * spellWorker(void * param) {
+    struct WorkerParams_s * worker = (struct WorkerParams_s *) param;
+    struct ThreadParams_s * params = worker->shared;
+    struct Connection_s * connection = NULL;
+
+    while ((connection = (struct Connection_s *) takeScheduler(params->scheduler, worker->index)) != NULL) {
+        enterDictionarySet(params->dictionaries, worker->index);
+        bool bOpen = serveConnectionBatch(params, connection, worker->index);
+        leaveDictionarySet(params->dictionaries, worker->index);
+        atomic_fetch_add(&params->metrics->batches, 1);
+
+        //lines already received go to the back of this worker's deque
+        if (bOpen && bShutdownDeadlinePassed == 0 && hasLineNetSocket(connection->socket)) {
+            pushLocalScheduler(params->scheduler, worker->index, connection);
+            continue;
         }
+
+        connection->bClosing = bOpen == false || bShutdownDeadlinePassed;
+        returnConnection(params, connection);
     }
     return NULL;
 }
 
+/* The state of the poller, which runs on the main thread. It accepts clients
+and waits for any of them to send something, then schedules them as tasks for
+the workers. It is the only thread which arms, closes or tracks
+connections. */
+struct Poller_s {
+    int epollFd;
+    struct Connection_s ** connections;
+    size_t numConnections;
+    size_t maxConnections;
+};
+
+#define MAX_POLL_EVENTS 64
+
+static char serverPollTag; //epoll data for the listening TCP socket
+static char localServerPollTag; //epoll data for the listening Unix domain socket
+static char wakePollTag; //epoll data for the wake eventfd
+
+/* Waits in the poller for the connection's client to send something. op is
+EPOLL_CTL_ADD for a new connection or EPOLL_CTL_MOD to re-arm one. Each wait
+fires only once, so a connection is never scheduled twice at a time. */
+static void armConnection(struct Poller_s * poller, struct Connection_s * connection, int op) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = connection;
+    connection->bScheduled = false;
+    epoll_ctl(poller->epollFd, op, connection->socket->socket_desc, &event);
+}
+
+/* Accepts a waiting client, or turns it away straight away if too many are
+already connected, rather than leave it hanging. */
+static void acceptConnection(struct Poller_s * poller, struct ThreadParams_s * params, NetSocket_t * server) {
+    NetSocket_t * client = acceptNetSocket(server);
+    if (client->errorNumber != 0) {
+        destroyNetSocket(client);
+        return;
+    }
+
+    if (poller->numConnections == poller->maxConnections) {
+        const char * busy = "!ERROR server busy\n";
+        writeNetSocket(client, (char *) busy, strlen(busy));
+        destroyNetSocket(client);
+        atomic_fetch_add(&params->metrics->rejectedConnections, 1);
+        return;
+    }
+
+    setNonBlockingNetSocket(client);
+    client->writeTimeoutMs = CLIENT_WRITE_TIMEOUT_MS;
+    client->bCancelWrites = &bShutdownDeadlinePassed;
+    struct Connection_s * connection = (struct Connection_s *) malloc(sizeof (struct Connection_s));
+    connection->socket = client;
+    connection->id = (uint32_t) atomic_fetch_add(&params->metrics->acceptedConnections, 1);
+    connection->selection = 1; //the default dictionary
+    connection->lastActivityMs = nowMilliseconds();
+    connection->bClosing = false;
+    connection->pollerIndex = poller->numConnections;
+    poller->connections[poller->numConnections++] = connection;
+    atomic_fetch_add(&params->metrics->openConnections, 1);
+
+    armConnection(poller, connection, EPOLL_CTL_ADD);
+    puts("Accepted a new connection.");
+}
+
+/* Closes a connection which no worker holds and forgets about it. */
+static void closeConnection(struct Poller_s * poller, struct ThreadParams_s * params, struct Connection_s * connection) {
+    epoll_ctl(poller->epollFd, EPOLL_CTL_DEL, connection->socket->socket_desc, NULL);
+
+    //move the last connection into the hole
+    struct Connection_s * last = poller->connections[--poller->numConnections];
+    poller->connections[connection->pollerIndex] = last;
+    last->pollerIndex = connection->pollerIndex;
+
+    destroyNetSocket(connection->socket);
+    free(connection);
+    atomic_fetch_sub(&params->metrics->openConnections, 1);
+    puts("Client disconnected.");
+}
+
+/* Closes or re-arms every connection the workers have handed back. */
+static void handleReturnedConnections(struct Poller_s * poller, struct ThreadParams_s * params) {
+    uint64_t count = 0;
+    if (read(params->wakeFd, &count, sizeof (count)) < 0) {
+        return;
+    }
+
+    struct Connection_s * connection = NULL;
+    while ((connection = (struct Connection_s *) tryPopThreadsafeQueue(params->returnQueue)) != NULL) {
+        if (connection->bClosing) {
+            closeConnection(poller, params, connection);
+        } else {
+            armConnection(poller, connection, EPOLL_CTL_MOD);
+        }
+    }
+}
+
+/* Closes every connection which is waiting in the poller and whose client
+has sent nothing for at least quietMs milliseconds. Used while shutting down
+to let go of idle clients while clients in the middle of a batch are
+finished. */
+static void closeQuietConnections(struct Poller_s * poller, struct ThreadParams_s * params, uint64_t quietMs) {
+    uint64_t now = nowMilliseconds();
+    for (size_t i = poller->numConnections; i > 0; i--) {
+        struct Connection_s * connection = poller->connections[i - 1];
+        if (connection->bScheduled == false && now - connection->lastActivityMs >= quietMs) {
+            closeConnection(poller, params, connection);
+        }
+    }
+}
+
 /* Worker function which handles writing output to a log on it's own thread
-and in a thread-safe manner. */
+and in a thread-safe manner. Returns once the log queue has been closed and
+everything on it has been written. */
 void * logWorker(void * param) {
     struct ThreadParams_s params = *((struct ThreadParams_s *) param);
 
     //setup logger
-    Logger_t * logger = newLogger("log.txt");
+    Logger_t * logger = NULL;
+    if (params.logFormat == LOG_FORMAT_BINARY) {
+        logger = newBinaryLogger("log.bin");
+    } else {
+        logger = newLogger("log.txt");
+    }
     if (logger == NULL) {
         puts("Couldn't open log file!");
         exit(EXIT_FAILURE);
     }
 
-    //read from queue and log until the sun burns out
-    while (1) {
-        char * str = popThreadsafeQueue(params.logQueue);
-        logText(logger, str);
+    //read from queue and log until it is closed
+    LogEntry_t * entry = NULL;
+    while ((entry = popThreadsafeQueue(params.logQueue)) != NULL) {
+        logEntry(logger, entry);
 
-        //this call effectively disables buffering, but it ensures our data is written.
-        flushLogger(logger);
+        //write out whenever we catch up, so the log stays current without
+        //giving up buffering while entries are arriving quickly
+        if (getThreadsafeQueueItems(params.logQueue) == 0) {
+            flushLogger(logger);
+        }
 
-        free(str); //we expect log elements to be malloc'd strings; must free
+        free(entry); //we expect log elements to be malloc'd entries; must free
     }
 
     destroyLogger(logger);
@@ -163,38 +705,134 @@ int main(int argc, char * argv[]) {
     //test libraries on running system
     testLogger();
     testTrie();
+    testDictionarySet();
     testSock();
     testThreadsafeQueue();
+    testScheduler();
+#ifdef SPELL_TRACE
+    testTrace();
+#endif
 
     //parse args and set configuration
     struct Configuration_s conf = setConfiguration(argc, argv);
     if (conf.bGoodConf == false) {
         puts("Invalid configuration. Please see below and in readme.txt for valid options.");
-        const char *optionsString = "\t-t <number> : The number of worker threads to spawn. This also serves as an "
-            "\n\t\tupper bound on the number of simultaneously connected clients."
+        const char *optionsString = "\t-t <number> : The number of worker threads to spawn. Connected clients share"
+            "\n\t\tthe workers a batch of words at a time."
             "\n\t\tThe default number of threads is 4."
-            "\n\t-d <file>   : Dictionary file to use. Words should be listed one per line."
-            "\n\t\tThe default dictionary is the included file \"words\"."
+            "\n\t-d [name=]<file> : Dictionary file to load. Words should be listed one per line."
+            "\n\t\tMay be given several times; the first is the default for new clients."
+            "\n\t\tThe file " BUILTIN_DICTIONARY_FILE " is the dictionary built into the program, which"
+            "\n\t\ttakes no time to load. It is the default, and is made from \"words\" unless"
+            "\n\t\tspell was built with \"make STATIC_DICTIONARY=<file>\"."
+            "\n\t-o <file>   : Extra words to add to the builtin dictionary, one per line. Only"
+            "\n\t\tallowed when exactly one -d (or the default) is the builtin dictionary."
             "\n\t-p <number> : TCP port to listen for incoming connections on. Default is "
-            "\n\t\tport 2667.";
+            "\n\t\tport 2667."
+            "\n\t-u <path>   : Also listen on a Unix domain socket created at <path>, for clients"
+            "\n\t\ton the same host."
+            "\n\t-n <list>   : Comma separated normalization policies applied to the dictionary"
+            "\n\t\tand to incoming words: case, accents, capitalized. Default is none."
+            "\n\t\tIt must match the policies the builtin dictionary was built with, if used;"
+            "\n\t\twithout -d the file the builtin dictionary was made from is loaded instead."
+            "\n\t-q <number> : Connections allowed beyond the number of worker threads before new"
+            "\n\t\tones are turned away. Default is the number of worker threads."
+            "\n\t-l <policy> : What to do with log entries when the log can't keep up: block,"
+            "\n\t\tdrop or spill (to log.spill.txt or log.spill.bin). Default is block."
+            "\n\t-f <format> : Log format: text (log.txt) or binary (log.bin and log.bin.words,"
+            "\n\t\tread with the spelllog tool). Default is text."
+            "\n\t-g <number> : Seconds to keep serving connected clients after SIGTERM or"
+            "\n\t\tSIGINT before they are disconnected. Default is 5 seconds."
+            "\n\t-s <number> : When built with \"make TRACE=1\", trace one in every <number> batches"
+            "\n\t\tto trace.json, or none if 0. Default is 100."
+            "\n\t-j <file>   : Journal of dictionary updates, replayed at startup and appended to"
+            "\n\t\tby !add and !remove. Default is no journal."
+            "\n\t-a <policy> : Which clients may use !add and !remove: local (Unix domain socket"
+            "\n\t\tclients only), all or none. Default is local.";
         puts(optionsString);
         exit(EXIT_FAILURE);
     }
 
-    //load dictionary from argv
-    Trie_t * dictionary = newTrieFromDictionary(conf.dictionaryFileName);
+    //load dictionaries from argv
+    DictionarySet_t * dictionaries = newDictionarySet(conf.numWorkers);
+    for (int i = 0; i < conf.numDictionaries; i++) {
+        bool bLoaded = strcmp(conf.dictionaryFileNames[i], BUILTIN_DICTIONARY_FILE) == 0
+                ? addBuiltinDictionaryToSet(dictionaries, conf.dictionaryNames[i], &staticDictionary, conf.overlayFileName)
+                : loadDictionaryToSet(dictionaries, conf.dictionaryNames[i], conf.dictionaryFileNames[i], conf.normalization);
+        if (bLoaded == false) {
+            printf("Couldn't load dictionary %s from %s!\n", conf.dictionaryNames[i], conf.dictionaryFileNames[i]);
+            exit(EXIT_FAILURE);
+        }
+        printf("Loaded dictionary %s: %zu words in %zu KiB\n", dictionaries->dictionaries[i].name,
+                atomic_load(&dictionaries->dictionaries[i].numWords),
+                atomic_load(&dictionaries->dictionaries[i].memoryUsage) / 1024);
+    }
+    if (conf.journalFileName != NULL) {
+        size_t numReplayed = 0;
+        if (openDictionaryJournal(dictionaries, conf.journalFileName, &numReplayed) == false) {
+            printf("Couldn't open dictionary journal %s!\n", conf.journalFileName);
+            exit(EXIT_FAILURE);
+        }
+        printf("Replayed %zu dictionary updates from %s\n", numReplayed, conf.journalFileName);
+    }
+
+    //only the main thread handles shutdown signals, so block them while
+    //the other threads are created and they will inherit the mask
+    sigset_t shutdownSignals;
+    sigemptyset(&shutdownSignals);
+    sigaddset(&shutdownSignals, SIGTERM);
+    sigaddset(&shutdownSignals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &shutdownSignals, NULL);
 
     //setup thread pool
-    ThreadsafeQueue_t * socketQueue = newThreadsafeQueue(conf.numWorkers);
+    setTraceSampleRate(conf.traceSampleRate);
+    size_t maxConnections = (size_t) conf.numWorkers + conf.maxPendingConnections;
+    Scheduler_t * scheduler = newScheduler(conf.numWorkers);
+    ThreadsafeQueue_t * returnQueue = newThreadsafeQueue(maxConnections);
     ThreadsafeQueue_t * logQueue = newThreadsafeQueue(4096);
+    int wakeFd = eventfd(0, EFD_NONBLOCK);
+    struct ServerMetrics_s metrics;
+    atomic_init(&metrics.acceptedConnections, 0);
+    atomic_init(&metrics.rejectedConnections, 0);
+    atomic_init(&metrics.openConnections, 0);
+    atomic_init(&metrics.batches, 0);
+    atomic_init(&metrics.logBlocked, 0);
+    atomic_init(&metrics.logDropped, 0);
+    atomic_init(&metrics.logSpilled, 0);
+    pthread_mutex_t spillMutex;
+    pthread_mutex_init(&spillMutex, NULL);
+
     struct ThreadParams_s tParams;
-    tParams.socketQueue = socketQueue;
+    tParams.scheduler = scheduler;
+    tParams.returnQueue = returnQueue;
+    tParams.wakeFd = wakeFd;
     tParams.logQueue = logQueue;
-    tParams.dictionary = dictionary;
+    tParams.dictionaries = dictionaries;
+    tParams.metrics = &metrics;
+    tParams.maxConnections = maxConnections;
+    tParams.adminPolicy = conf.adminPolicy;
+    tParams.logFormat = conf.logFormat;
+    tParams.logOverflowPolicy = conf.logOverflowPolicy;
+    tParams.spillMutex = &spillMutex;
+    tParams.spillLogger = NULL;
+    if (conf.logOverflowPolicy == LOG_OVERFLOW_SPILL) {
+        if (conf.logFormat == LOG_FORMAT_BINARY) {
+            tParams.spillLogger = newBinaryLogger("log.spill.bin");
+        } else {
+            tParams.spillLogger = newLogger("log.spill.txt");
+        }
+        if (tParams.spillLogger == NULL) {
+            puts("Couldn't open log spill file!");
+            exit(EXIT_FAILURE);
+        }
+    }
 
     pthread_t workerThreads[conf.numWorkers];
+    struct WorkerParams_s workerParams[conf.numWorkers];
     for (int i = 0; i < conf.numWorkers; i++) {
-        if (pthread_create(&workerThreads[i], NULL, spellWorker, &tParams) != 0) {
+        workerParams[i].shared = &tParams;
+        workerParams[i].index = i;
+        if (pthread_create(&workerThreads[i], NULL, spellWorker, &workerParams[i]) != 0) {
             exit(EXIT_FAILURE);
         }
     }
@@ -204,21 +842,131 @@ int main(int argc, char * argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    //no SA_RESTART, so a signal interrupts the wait for events below
+    struct sigaction shutdownAction;
+    memset(&shutdownAction, 0, sizeof (shutdownAction));
+    shutdownAction.sa_handler = requestShutdown;
+    sigemptyset(&shutdownAction.sa_mask);
+    sigaction(SIGTERM, &shutdownAction, NULL);
+    sigaction(SIGINT, &shutdownAction, NULL);
+    pthread_sigmask(SIG_UNBLOCK, &shutdownSignals, NULL);
+
     //setup server socket
     NetSocket_t * server = newNetSocketServer(conf.port);
     listenNetSocket(server);
+    NetSocket_t * localServer = NULL;
+    if (conf.localSocketPath != NULL) {
+        localServer = newNetSocketLocalServer(conf.localSocketPath);
+        if (localServer->errorNumber != 0 || listenNetSocket(localServer) == false) {
+            char * error = getNetSocketError(localServer);
+            printf("Couldn't listen on %s: %s\n", conf.localSocketPath, error);
+            free(error);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //setup poller
+    struct Poller_s poller;
+    poller.epollFd = epoll_create1(0);
+    poller.connections = (struct Connection_s **) malloc(sizeof (struct Connection_s *) * maxConnections);
+    poller.numConnections = 0;
+    poller.maxConnections = maxConnections;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &serverPollTag;
+    epoll_ctl(poller.epollFd, EPOLL_CTL_ADD, server->socket_desc, &event);
+    if (localServer != NULL) {
+        event.data.ptr = &localServerPollTag;
+        epoll_ctl(poller.epollFd, EPOLL_CTL_ADD, localServer->socket_desc, &event);
+    }
+    event.data.ptr = &wakePollTag;
+    epoll_ctl(poller.epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+    //accept clients and schedule them whenever they send something. Once a
+    //shutdown is requested, stop accepting and let go of clients as they go
+    //quiet, cutting off whoever is left at the deadline.
+    const int pollIntervalMs = 250;
+    const uint64_t quietMs = 250;
+    bool bShuttingDown = false;
+    uint64_t deadlineMs = 0;
+    struct epoll_event events[MAX_POLL_EVENTS];
+    while (bShuttingDown == false || poller.numConnections > 0) {
+        int numEvents = epoll_wait(poller.epollFd, events, MAX_POLL_EVENTS, pollIntervalMs);
+        for (int i = 0; i < numEvents; i++) {
+            if (events[i].data.ptr == &serverPollTag) {
+                acceptConnection(&poller, &tParams, server);
+            } else if (events[i].data.ptr == &localServerPollTag) {
+                acceptConnection(&poller, &tParams, localServer);
+            } else if (events[i].data.ptr == &wakePollTag) {
+                handleReturnedConnections(&poller, &tParams);
+            } else {
+                struct Connection_s * connection = (struct Connection_s *) events[i].data.ptr;
+                connection->bScheduled = true;
+                submitScheduler(scheduler, connection);
+            }
+        }
+
+        if (bShutdownRequested && bShuttingDown == false) {
+            puts("Shutting down...");
+            epoll_ctl(poller.epollFd, EPOLL_CTL_DEL, server->socket_desc, NULL);
+            destroyNetSocket(server);
+            if (localServer != NULL) {
+                epoll_ctl(poller.epollFd, EPOLL_CTL_DEL, localServer->socket_desc, NULL);
+                destroyNetSocket(localServer);
+                unlink(conf.localSocketPath);
+            }
+            bShuttingDown = true;
+            deadlineMs = nowMilliseconds() + (uint64_t) conf.shutdownGraceSeconds * 1000;
+        }
+        if (bShuttingDown) {
+            if (bShutdownDeadlinePassed == 0 && nowMilliseconds() >= deadlineMs) {
+                puts("Shutdown deadline passed, disconnecting remaining clients.");
+                bShutdownDeadlinePassed = 1;
+            }
+            closeQuietConnections(&poller, &tParams, bShutdownDeadlinePassed ? 0 : quietMs);
+        }
+    }
 
-    //loop listen for incoming connections and enqueue them
-    while (1) {
-        pushThreadsafeQueue(socketQueue, acceptNetSocket(server));
-        puts("Accepted a new connection.");
+    //every connection is closed, so the workers have nothing left to do
+    closeScheduler(scheduler);
+    for (int i = 0; i < conf.numWorkers; i++) {
+        pthread_join(workerThreads[i], NULL);
     }
 
+    //every worker is done, so nothing more can be logged
+    closeThreadsafeQueue(logQueue);
+    pthread_join(logThread, NULL);
+
+#ifdef SPELL_TRACE
+    //every worker has exited, so their traces can be read
+    printTraceHistograms(stdout);
+    if (dumpTrace("trace.json") == false) {
+        puts("Couldn't write trace.json!");
+    }
+    destroyTraces();
+#endif
+
     //clean up
-    //TODO Would be nice to make the threads join instead of waiting for the
-    //socket queue eternally
-    destroyNetSocket(server);
-    destroyTrie(dictionary);
+    char * stats = getDictionarySetStats(dictionaries);
+    fputs(stats, stdout);
+    free(stats);
+    stats = getServerStats(&tParams);
+    fputs(stats, stdout);
+    free(stats);
+
+    if (tParams.spillLogger != NULL) {
+        destroyLogger(tParams.spillLogger);
+    }
+    pthread_mutex_destroy(&spillMutex);
+
+    close(poller.epollFd);
+    close(wakeFd);
+    free(poller.connections);
+    destroyScheduler(scheduler);
+    destroyThreadsafeQueue(returnQueue);
+    destroyThreadsafeQueue(logQueue);
+    destroyDictionarySet(dictionaries);
 
+    puts("Shut down cleanly.");
     return 0;
 }
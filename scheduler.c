@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+#include "scheduler.h"
+
+/* Initializes an empty WorkDeque_t. */
+static void initWorkDeque(WorkDeque_t * deque) {
+    pthread_mutex_init(&deque->mutex, NULL);
+    deque->capacity = INITIAL_WORK_DEQUE_CAPACITY;
+    deque->tasks = (void **) malloc(sizeof (void *) * deque->capacity);
+    deque->head = 0;
+    deque->count = 0;
+}
+
+/* Pushes a task to the back of a WorkDeque_t, growing it if it is full. */
+static void pushBackWorkDeque(WorkDeque_t * deque, void * task) {
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == deque->capacity) {
+        void ** tasks = (void **) malloc(sizeof (void *) * deque->capacity * 2);
+        for (size_t i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->head = 0;
+        deque->capacity *= 2;
+    }
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->mutex);
+}
+
+/* Pops the oldest task from the front of a WorkDeque_t, or returns NULL if it
+is empty. */
+static void * popFrontWorkDeque(WorkDeque_t * deque) {
+    void * task = NULL;
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+/* Pops the newest task from the back of a WorkDeque_t, or returns NULL if it
+is empty. */
+static void * popBackWorkDeque(WorkDeque_t * deque) {
+    void * task = NULL;
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        deque->count--;
+        task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+/* Allocates a new Scheduler_t with a deque for each of numWorkers workers,
+and returns a pointer to it. */
+Scheduler_t * newScheduler(size_t numWorkers) {
+    Scheduler_t * scheduler = (Scheduler_t *) malloc(sizeof (Scheduler_t));
+    scheduler->deques = (WorkDeque_t *) malloc(sizeof (WorkDeque_t) * numWorkers);
+    for (size_t i = 0; i < numWorkers; i++) {
+        initWorkDeque(&scheduler->deques[i]);
+    }
+    scheduler->numWorkers = numWorkers;
+    atomic_init(&scheduler->pendingTasks, 0);
+    atomic_init(&scheduler->nextDeque, 0);
+    atomic_init(&scheduler->steals, 0);
+    pthread_mutex_init(&scheduler->idleMutex, NULL);
+    pthread_cond_init(&scheduler->workAvailable, NULL);
+    scheduler->closed = false;
+    return scheduler;
+}
+
+/* Deallocates a Scheduler_t. Any tasks still on it are not freed. */
+void destroyScheduler(Scheduler_t * scheduler) {
+    for (size_t i = 0; i < scheduler->numWorkers; i++) {
+        pthread_mutex_destroy(&scheduler->deques[i].mutex);
+        free(scheduler->deques[i].tasks);
+    }
+    free(scheduler->deques);
+    pthread_mutex_destroy(&scheduler->idleMutex);
+    pthread_cond_destroy(&scheduler->workAvailable);
+    free(scheduler);
+}
+
+/* Wakes a worker to take a task which was just pushed. The task must have
+been counted in pendingTasks before it was pushed, so that a worker taking it
+straight away never brings the count below the number of tasks queued. */
+static void announceTask(Scheduler_t * scheduler) {
+    pthread_mutex_lock(&scheduler->idleMutex);
+    pthread_cond_signal(&scheduler->workAvailable);
+    pthread_mutex_unlock(&scheduler->idleMutex);
+}
+
+/* Submits a task from outside the workers. Tasks are spread over the deques
+round robin; idle workers steal any imbalance. */
+void submitScheduler(Scheduler_t * scheduler, void * task) {
+    size_t worker = atomic_fetch_add(&scheduler->nextDeque, 1) % scheduler->numWorkers;
+    atomic_fetch_add(&scheduler->pendingTasks, 1);
+    pushBackWorkDeque(&scheduler->deques[worker], task);
+    announceTask(scheduler);
+}
+
+/* Pushes a task to the back of the deque of the given worker, behind the
+tasks already waiting there. Used by a worker to continue a task later
+without keeping others waiting. */
+void pushLocalScheduler(Scheduler_t * scheduler, size_t worker, void * task) {
+    atomic_fetch_add(&scheduler->pendingTasks, 1);
+    pushBackWorkDeque(&scheduler->deques[worker], task);
+    announceTask(scheduler);
+}
+
+/* Returns the next task for the given worker: the oldest task on it's own
+deque, or failing that the newest task stolen from another worker. Waits
+while there are no tasks anywhere. Returns NULL once the scheduler has been
+closed and every task has been taken. */
+void * takeScheduler(Scheduler_t * scheduler, size_t worker) {
+    while (1) {
+        void * task = popFrontWorkDeque(&scheduler->deques[worker]);
+        for (size_t i = 1; task == NULL && i < scheduler->numWorkers; i++) {
+            task = popBackWorkDeque(&scheduler->deques[(worker + i) % scheduler->numWorkers]);
+            if (task != NULL) {
+                atomic_fetch_add(&scheduler->steals, 1);
+            }
+        }
+        if (task != NULL) {
+            atomic_fetch_sub(&scheduler->pendingTasks, 1);
+            return task;
+        }
+
+        pthread_mutex_lock(&scheduler->idleMutex);
+        while (atomic_load(&scheduler->pendingTasks) == 0 && scheduler->closed == false) {
+            pthread_cond_wait(&scheduler->workAvailable, &scheduler->idleMutex);
+        }
+        bool bFinished = scheduler->closed && atomic_load(&scheduler->pendingTasks) == 0;
+        pthread_mutex_unlock(&scheduler->idleMutex);
+        if (bFinished) {
+            return NULL;
+        }
+    }
+}
+
+/* Closes the scheduler, waking every waiting worker. Tasks already on it are
+still taken, after which takeScheduler returns NULL. */
+void closeScheduler(Scheduler_t * scheduler) {
+    pthread_mutex_lock(&scheduler->idleMutex);
+    scheduler->closed = true;
+    pthread_cond_broadcast(&scheduler->workAvailable);
+    pthread_mutex_unlock(&scheduler->idleMutex);
+}
+
+struct SchedulerTestParams_s {
+    Scheduler_t * scheduler;
+    size_t worker;
+    size_t sum;
+};
+
+/* Function used by testScheduler to emulate a worker thread. */
+static void * schedulerTestWorker(void * param) {
+    struct SchedulerTestParams_s * params = (struct SchedulerTestParams_s *) param;
+    size_t * task = NULL;
+    while ((task = (size_t *) takeScheduler(params->scheduler, params->worker)) != NULL) {
+        params->sum += *task;
+    }
+    return NULL;
+}
+
+/* Test cases for the Scheduler_t functions. */
+void testScheduler() {
+    size_t values[200];
+    for (size_t i = 0; i < 200; i++) {
+        values[i] = i + 1;
+    }
+
+    //the owner takes oldest first, and a thief takes the newest
+    Scheduler_t * scheduler = newScheduler(2);
+    pushLocalScheduler(scheduler, 0, &values[0]);
+    pushLocalScheduler(scheduler, 0, &values[1]);
+    pushLocalScheduler(scheduler, 0, &values[2]);
+    assert(takeScheduler(scheduler, 0) == &values[0]);
+    assert(takeScheduler(scheduler, 1) == &values[2]);
+    assert(atomic_load(&scheduler->steals) == 1);
+    assert(takeScheduler(scheduler, 1) == &values[1]);
+    closeScheduler(scheduler);
+    assert(takeScheduler(scheduler, 0) == NULL);
+    destroyScheduler(scheduler);
+
+    //every submitted task is taken exactly once across workers
+    const size_t numWorkers = 4;
+    scheduler = newScheduler(numWorkers);
+    pthread_t threads[numWorkers];
+    struct SchedulerTestParams_s params[numWorkers];
+    for (size_t i = 0; i < numWorkers; i++) {
+        params[i].scheduler = scheduler;
+        params[i].worker = i;
+        params[i].sum = 0;
+        assert(pthread_create(&threads[i], NULL, schedulerTestWorker, &params[i]) == 0);
+    }
+    for (size_t i = 0; i < 200; i++) {
+        submitScheduler(scheduler, &values[i]);
+    }
+    closeScheduler(scheduler);
+    size_t sum = 0;
+    for (size_t i = 0; i < numWorkers; i++) {
+        pthread_join(threads[i], NULL);
+        sum += params[i].sum;
+    }
+    assert(sum == 200 * 201 / 2);
+    destroyScheduler(scheduler);
+}
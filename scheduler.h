@@ -0,0 +1,43 @@
+//See scheduler.c for function documentation.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define INITIAL_WORK_DEQUE_CAPACITY 64
+
+/* A double ended queue of tasks belonging to one worker. The owner takes from
+the front and pushes to the back; other workers steal from the back. */
+typedef struct WorkDeque_s {
+    pthread_mutex_t mutex;
+    void ** tasks;
+    size_t head;
+    size_t count;
+    size_t capacity;
+} WorkDeque_t;
+
+typedef struct Scheduler_s {
+    WorkDeque_t * deques; //one per worker
+    size_t numWorkers;
+    atomic_size_t pendingTasks; //tasks on any deque, counted before they are pushed
+    atomic_size_t nextDeque; //round robin target for submitted tasks
+    atomic_size_t steals;
+    pthread_mutex_t idleMutex;
+    pthread_cond_t workAvailable;
+    bool closed; //guarded by idleMutex
+} Scheduler_t;
+
+Scheduler_t * newScheduler(size_t numWorkers);
+void destroyScheduler(Scheduler_t * scheduler);
+
+void submitScheduler(Scheduler_t * scheduler, void * task);
+void pushLocalScheduler(Scheduler_t * scheduler, size_t worker, void * task);
+void * takeScheduler(Scheduler_t * scheduler, size_t worker);
+void closeScheduler(Scheduler_t * scheduler);
+
+void testScheduler();
+
+#endif /* SCHEDULER_H */
@@ -5,6 +5,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
 #include "sck.h"
 
 /* Allocates a new SocketPayload_t data structure and returns a pointer to it. */
@@ -32,6 +36,7 @@ void destroyNetSocket(NetSocket_t * sock) {
     //for a more serious library, we would do thorough checking
     //of close conditions for the socket.
     close(sock->socket_desc);
+    free(sock->receiveBuffer);
     free(sock);
 }
 
@@ -39,6 +44,14 @@ void destroyNetSocket(NetSocket_t * sock) {
 static NetSocket_t * newNetSocket() {
     NetSocket_t * sock = (NetSocket_t *) malloc(sizeof (NetSocket_t));
     sock->errorNumber = 0;
+    sock->bLocal = false;
+    sock->receiveBuffer = NULL;
+    sock->receiveCapacity = 0;
+    sock->receiveStart = 0;
+    sock->receiveEnd = 0;
+    sock->bReceiveClosed = false;
+    sock->writeTimeoutMs = -1;
+    sock->bCancelWrites = NULL;
     return sock;
 }
 
@@ -59,10 +72,44 @@ NetSocket_t * newNetSocketClient(char * address, uint16_t port) {
     return sock;
 }
 
-/* Connects a TCP client socket that was previously created with newNetSocketClient
- to a server. Returns true/false on success/failure. */
+/* Fills in the address of a Unix domain socket at path. Returns false if the
+path is too long to be a socket address. */
+static bool setLocalAddress(NetSocket_t * sock, char * path) {
+    sock->bLocal = true;
+    memset(&sock->localAddress, 0, sizeof (sock->localAddress));
+    sock->localAddress.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof (sock->localAddress.sun_path)) {
+        sock->errorNumber = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(sock->localAddress.sun_path, path);
+    return true;
+}
+
+/* Creates a client socket for a server listening on the Unix domain socket at
+path, on the same host. Does not connect the socket or take any additional
+action. */
+NetSocket_t * newNetSocketLocalClient(char * path) {
+    NetSocket_t * sock = newNetSocket();
+    sock->socket_desc = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock->socket_desc < 0) {
+        sock->errorNumber = errno;
+        return sock;
+    }
+    setLocalAddress(sock, path);
+    return sock;
+}
+
+/* Connects a client socket that was previously created with newNetSocketClient
+or newNetSocketLocalClient to a server. Returns true/false on success/failure. */
 bool connectNetSocket(NetSocket_t * socket) {
-    if (connect(socket->socket_desc, (struct sockaddr *) &(socket->server), sizeof (socket->server)) < 0) {
+    struct sockaddr * address = (struct sockaddr *) &(socket->server);
+    socklen_t addressLength = sizeof (socket->server);
+    if (socket->bLocal) {
+        address = (struct sockaddr *) &(socket->localAddress);
+        addressLength = sizeof (socket->localAddress);
+    }
+    if (socket->errorNumber != 0 || connect(socket->socket_desc, address, addressLength) < 0) {
         socket->errorNumber = errno;
         return false;
     }
@@ -94,6 +141,50 @@ NetSocket_t * newNetSocketServer(uint16_t port) {
     return sock;
 }
 
+/* Returns true if path is a Unix domain socket which nothing is listening on,
+such as one left behind by a server which was killed. */
+static bool isStaleLocalSocket(NetSocket_t * sock, char * path) {
+    struct stat status;
+    if (lstat(path, &status) < 0 || S_ISSOCK(status.st_mode) == false) {
+        return false;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        return false;
+    }
+    bool bStale = connect(probe, (struct sockaddr *) &(sock->localAddress), sizeof (sock->localAddress)) < 0
+            && errno == ECONNREFUSED;
+    close(probe);
+    return bStale;
+}
+
+/* Allocates a NetSocket_t data structure which is configured for listening on a
+Unix domain socket created at path. Clients on the same host connecting to it
+skip the TCP/IP stack entirely. A stale socket left at path by a previous run
+is replaced, but anything else there, including a socket another server is
+listening on, makes binding fail with EADDRINUSE. */
+NetSocket_t * newNetSocketLocalServer(char * path) {
+    NetSocket_t * sock = newNetSocket();
+    sock->socket_desc = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock->socket_desc < 0) {
+        sock->errorNumber = errno;
+        return sock;
+    }
+    if (setLocalAddress(sock, path) == false) {
+        return sock;
+    }
+
+    if (isStaleLocalSocket(sock, path)) {
+        unlink(path);
+    }
+    if (bind(sock->socket_desc, (struct sockaddr *) &(sock->localAddress), sizeof (sock->localAddress)) < 0) {
+        sock->errorNumber = errno;
+        return sock;
+    }
+
+    return sock;
+}
+
 /* Start a NetSocket_t listening for connections on it's pre-configured port. */
 bool listenNetSocket(NetSocket_t * socket) {
     if (listen(socket->socket_desc, 3) < 0) {
@@ -108,8 +199,14 @@ This returns a pointer to a newly allocated NetSocket_t which can be used to
 communicate with the newly accepted connection. */
 NetSocket_t * acceptNetSocket(NetSocket_t * serverSocket) {
     NetSocket_t * sock = newNetSocket();
-    size_t sockaddrInSize = sizeof (struct sockaddr_in);
-    sock->socket_desc = accept(serverSocket->socket_desc, (struct sockaddr *) &(sock->server), (socklen_t *) & sockaddrInSize);
+    if (serverSocket->bLocal) {
+        //the client of a Unix domain socket is usually unnamed
+        sock->bLocal = true;
+        sock->socket_desc = accept(serverSocket->socket_desc, NULL, NULL);
+    } else {
+        socklen_t sockaddrInSize = sizeof (struct sockaddr_in);
+        sock->socket_desc = accept(serverSocket->socket_desc, (struct sockaddr *) &(sock->server), &sockaddrInSize);
+    }
     if (sock->socket_desc < 0) {
         sock->errorNumber = errno;
         return sock;
@@ -131,58 +228,214 @@ SocketPayload_t * readNetSocket(NetSocket_t * socket, size_t numBytes) {
     return payload;
 }
 
+/* Receive whatever bytes are available on the NetSocket_t into it's receive
+buffer with a single recv, blocking until at least one byte arrives. Lines
+which have not been returned yet are moved to the front of the buffer first,
+so pointers returned by nextLineNetSocket are no longer valid after this
+call. Returns the number of bytes received, 0 once the peer has disconnected
+and -1 on error. */
+ssize_t receiveNetSocket(NetSocket_t * socket) {
+    if (socket->receiveBuffer == NULL) {
+        socket->receiveCapacity = INITIAL_NETSOCKET_RECEIVE_BUFFER;
+        socket->receiveBuffer = (char *) malloc(socket->receiveCapacity);
+    }
+
+    //keep the unreturned bytes, and grow if they already fill the buffer
+    size_t pending = socket->receiveEnd - socket->receiveStart;
+    memmove(socket->receiveBuffer, socket->receiveBuffer + socket->receiveStart, pending);
+    socket->receiveStart = 0;
+    socket->receiveEnd = pending;
+    if (pending == socket->receiveCapacity) {
+        socket->receiveCapacity *= 2;
+        socket->receiveBuffer = (char *) realloc(socket->receiveBuffer, socket->receiveCapacity);
+    }
+
+    ssize_t received = 0;
+    do {
+        received = recv(socket->socket_desc, socket->receiveBuffer + socket->receiveEnd,
+                socket->receiveCapacity - socket->receiveEnd, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0) {
+        socket->errorNumber = errno;
+        return -1;
+    }
+    if (received == 0) {
+        socket->bReceiveClosed = true;
+    }
+    socket->receiveEnd += received;
+    return received;
+}
+
+/* Returns a pointer to the next complete line in the receive buffer of the
+NetSocket_t, without copying it, and stores it's length (not counting the
+newline) in length. The newline is overwritten with a null terminator. Once
+the peer has disconnected, any trailing bytes without a newline are returned
+as a final line. Returns NULL if no complete line has been received; call
+receiveNetSocket to get more. The line is only valid until receiveNetSocket
+is next called. */
+char * nextLineNetSocket(NetSocket_t * socket, size_t * length) {
+    char * start = socket->receiveBuffer + socket->receiveStart;
+    size_t pending = socket->receiveEnd - socket->receiveStart;
+    if (pending == 0) {
+        return NULL;
+    }
+
+    char * newline = (char *) memchr(start, '\n', pending);
+    if (newline != NULL) {
+        *newline = '\0';
+        *length = newline - start;
+        socket->receiveStart += *length + 1;
+        return start;
+    }
+
+    if (socket->bReceiveClosed) {
+        //there is no room for a terminator past the end if the buffer is full
+        if (socket->receiveEnd == socket->receiveCapacity) {
+            socket->receiveBuffer = (char *) realloc(socket->receiveBuffer, socket->receiveCapacity + 1);
+            socket->receiveCapacity++;
+            start = socket->receiveBuffer + socket->receiveStart;
+        }
+        start[pending] = '\0';
+        *length = pending;
+        socket->receiveStart = socket->receiveEnd;
+        return start;
+    }
+    return NULL;
+}
+
+/* Returns true if nextLineNetSocket would return a line without receiving
+anything more. */
+bool hasLineNetSocket(NetSocket_t * socket) {
+    size_t pending = socket->receiveEnd - socket->receiveStart;
+    if (pending == 0) {
+        return false;
+    }
+    return socket->bReceiveClosed || memchr(socket->receiveBuffer + socket->receiveStart, '\n', pending) != NULL;
+}
+
 /* Read a full line (terminated by a newline character) from a NetSocket_t.
 Returns a pointer to a newly allocated SocketPayload_t if the line was read,
 otherwise returns NULL in the case of an error (for example, the socket was
 disconnected) */
 SocketPayload_t * readLineNetSocket(NetSocket_t * socket) {
-    const size_t defaultPayloadSize = 256;
-    SocketPayload_t * payload = newSocketPayload(defaultPayloadSize);
-    char c = '\0';
-    bool bReceiving = true;
-    size_t curChar = 0;
-    while (bReceiving) {
-        int sizeIn = 0;
-        sizeIn = recv(socket->socket_desc, &c, 1, 0);
-
-        if (sizeIn == EOF || sizeIn == 0) {
-            //client disconnected
-            bReceiving = false;
-            if (curChar > 0) { //we've read some bytes, return those only
-                payload->data[curChar] = '\0';
-                payload->size = curChar;
-                return payload;
-            } else { //if we've read 0 bytes, the socket is disconnected
-                destroySocketPayload(payload);
-                return NULL;
-            }
-        } else {
-            if (c == '\n') {
-                payload->data[curChar] = '\0';
-                payload->size = curChar;
-                return payload;
-            }
-
-            payload->data[curChar] = c;
-            curChar++;
-
-            //realloc if we've exceeded payload container capacity
-            if (curChar == payload->capacity) {
-                SocketPayload_t * newPayload = newSocketPayload(payload->capacity * 2);
-                memcpy(newPayload->data, payload->data, payload->capacity);
-                destroySocketPayload(payload);
-                payload = newPayload;
-            }
+    char * line = NULL;
+    size_t length = 0;
+    while ((line = nextLineNetSocket(socket, &length)) == NULL) {
+        if (socket->bReceiveClosed || receiveNetSocket(socket) < 0) {
+            return NULL;
         }
     }
+
+    SocketPayload_t * payload = newSocketPayload(length + 1);
+    memcpy(payload->data, line, length + 1);
+    payload->size = length;
     return payload;
 }
 
-/* Write numBytes from bytes to the NetSocket_t socket provided. */
+/* Wait up to timeoutMs milliseconds for the NetSocket_t to have data to read, 
+or for a listening NetSocket_t to have a connection to accept. Returns 1 if it
+is ready, 0 if the time ran out and -1 on error, including being interrupted
+by a signal. A hung up or failed socket counts as ready, so that the following
+read reports it. */
+int waitReadableNetSocket(NetSocket_t * socket, int timeoutMs) {
+    struct pollfd pfd;
+    pfd.fd = socket->socket_desc;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, timeoutMs);
+    if (ready < 0) {
+        socket->errorNumber = errno;
+        return -1;
+    }
+    return ready > 0 ? 1 : 0;
+}
+
+/* Put the NetSocket_t in non-blocking mode, so that receiveNetSocket returns
+-1 with errorNumber set to EAGAIN instead of waiting when nothing has
+arrived. Writes still wait until everything is sent. */
+bool setNonBlockingNetSocket(NetSocket_t * socket) {
+    int flags = fcntl(socket->socket_desc, F_GETFL, 0);
+    if (flags < 0 || fcntl(socket->socket_desc, F_SETFL, flags | O_NONBLOCK) < 0) {
+        socket->errorNumber = errno;
+        return false;
+    }
+    return true;
+}
+
+/* Shut down both directions of a connected NetSocket_t without releasing it.
+Any thread blocked reading from the socket sees it as disconnected. */
+void shutdownNetSocket(NetSocket_t * socket) {
+    shutdown(socket->socket_desc, SHUT_RDWR);
+}
+
+/* Write numBytes from bytes to the NetSocket_t socket provided. A peer which
+has disconnected makes this return false rather than raising SIGPIPE. */
 bool writeNetSocket(NetSocket_t * socket, char * bytes, size_t numBytes) {
-    if (send(socket->socket_desc, bytes, numBytes, 0) < 0) {
+    struct iovec iov;
+    iov.iov_base = bytes;
+    iov.iov_len = numBytes;
+    return writevNetSocket(socket, &iov, 1);
+}
+
+/* Write the buffers described by count iovecs to the NetSocket_t, gathering
+them into as few sends as possible without copying them. Partial sends are
+resumed until everything is written, waiting for the peer to make room if the
+socket is non-blocking. A peer which makes no room for writeTimeoutMs, or
+bCancelWrites being set while waiting, makes this give up and return false
+with errorNumber set to ETIMEDOUT. The iovecs are modified as they are sent. */
+bool writevNetSocket(NetSocket_t * socket, struct iovec * iov, int count) {
+    struct msghdr message;
+    memset(&message, 0, sizeof (message));
+    int waitedMs = 0; //since the peer last made room
+
+    //part of an earlier write is missing, so nothing written now would make sense
+    if (socket->errorNumber == ETIMEDOUT) {
         return false;
     }
+
+    while (count > 0) {
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t sent = sendmsg(socket->socket_desc, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd;
+                pfd.fd = socket->socket_desc;
+                pfd.events = POLLOUT;
+                if ((socket->bCancelWrites != NULL && *socket->bCancelWrites)
+                        || (socket->writeTimeoutMs >= 0 && waitedMs >= socket->writeTimeoutMs)) {
+                    socket->errorNumber = ETIMEDOUT;
+                    return false;
+                }
+                int pollMs = NETSOCKET_WRITE_POLL_MS;
+                if (socket->writeTimeoutMs >= 0 && socket->writeTimeoutMs - waitedMs < pollMs) {
+                    pollMs = socket->writeTimeoutMs - waitedMs;
+                }
+                if (poll(&pfd, 1, pollMs) == 0) {
+                    waitedMs += pollMs;
+                }
+                continue;
+            }
+            socket->errorNumber = errno;
+            return false;
+        }
+
+        //skip past whatever was sent, which may end part way through an iovec
+        waitedMs = 0;
+        while (count > 0 && (size_t) sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
     return true;
 }
 
@@ -228,10 +481,99 @@ void testSock() {
         assert(strcmp(payload->data, "hello") == 0);
     }
 
+    destroySocketPayload(payload);
+
+    //lines are returned in place from the receive buffer, across receives
+    char * line = NULL;
+    size_t length = 0;
+    assert(writeNetSocket(clientSock, "one\ntwo\nthr", 11) == true);
+    while (serverToClientSock->receiveEnd < 11) {
+        assert(receiveNetSocket(serverToClientSock) > 0);
+    }
+    assert((line = nextLineNetSocket(serverToClientSock, &length)) != NULL);
+    assert(length == 3 && strcmp(line, "one") == 0);
+    assert((line = nextLineNetSocket(serverToClientSock, &length)) != NULL);
+    assert(length == 3 && strcmp(line, "two") == 0);
+    assert(nextLineNetSocket(serverToClientSock, &length) == NULL);
+
+    //responses are gathered from separate buffers
+    struct iovec iov[3] = {
+        { "ee", 2 },
+        { "\n", 1 },
+        { "last", 4 }
+    };
+    assert(writevNetSocket(clientSock, iov, 3) == true);
+    shutdown(clientSock->socket_desc, SHUT_WR);
+    payload = readLineNetSocket(serverToClientSock);
+    assert(payload != NULL && strcmp(payload->data, "three") == 0);
+    destroySocketPayload(payload);
+    payload = readLineNetSocket(serverToClientSock);
+    assert(payload != NULL && payload->size == 4 && strcmp(payload->data, "last") == 0);
+    destroySocketPayload(payload);
+    assert(readLineNetSocket(serverToClientSock) == NULL);
+
+    //a peer which never reads can't hold a writer for ever
+    const size_t floodSize = 1 << 24;
+    char * flood = calloc(floodSize, 1);
+    volatile sig_atomic_t bCancel = 1;
+    setNonBlockingNetSocket(serverToClientSock);
+    serverToClientSock->bCancelWrites = &bCancel;
+    assert(writeNetSocket(serverToClientSock, flood, floodSize) == false);
+    assert(serverToClientSock->errorNumber == ETIMEDOUT);
+    assert(writeNetSocket(serverToClientSock, flood, 1) == false); //the stream is already broken
+    serverToClientSock->bCancelWrites = NULL;
+    serverToClientSock->errorNumber = 0;
+    serverToClientSock->writeTimeoutMs = 50;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(writeNetSocket(serverToClientSock, flood, floodSize) == false);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    assert(serverToClientSock->errorNumber == ETIMEDOUT);
+    long waitedMs = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    assert(waitedMs >= 50 && waitedMs < 50 + NETSOCKET_WRITE_POLL_MS);
+    free(flood);
+
     destroyNetSocket(clientSock);
     destroyNetSocket(serverToClientSock);
     destroyNetSocket(serverSock);
 
+    //the same over a Unix domain socket
+    assert((serverSock = newNetSocketLocalServer("testsock.sock"))->errorNumber == 0);
+    assert(listenNetSocket(serverSock));
+    assert((clientSock = newNetSocketLocalClient("testsock.sock"))->errorNumber == 0);
+    assert(connectNetSocket(clientSock));
+    assert((serverToClientSock = acceptNetSocket(serverSock))->errorNumber == 0);
+    assert(serverToClientSock->bLocal);
+    assert(writeNetSocket(clientSock, "local\n", 6) == true);
+    assert(receiveNetSocket(serverToClientSock) > 0);
+    assert((line = nextLineNetSocket(serverToClientSock, &length)) != NULL);
+    assert(length == 5 && strcmp(line, "local") == 0);
+
+    //a live server's socket is left alone, and only sees the probe come and go
+    NetSocket_t * secondServerSock = newNetSocketLocalServer("testsock.sock");
+    assert(secondServerSock->errorNumber == EADDRINUSE);
+    destroyNetSocket(secondServerSock);
+    NetSocket_t * probeSock = acceptNetSocket(serverSock);
+    assert(probeSock->errorNumber == 0 && receiveNetSocket(probeSock) == 0);
+    destroyNetSocket(probeSock);
+    destroyNetSocket(clientSock);
+    destroyNetSocket(serverToClientSock);
+    destroyNetSocket(serverSock);
+
+    //the socket left behind is stale and replaced, other files are kept
+    assert((serverSock = newNetSocketLocalServer("testsock.sock"))->errorNumber == 0);
+    destroyNetSocket(serverSock);
+    unlink("testsock.sock");
+    FILE * file = fopen("testsock.sock", "w");
+    fclose(file);
+    assert((serverSock = newNetSocketLocalServer("testsock.sock"))->errorNumber == EADDRINUSE);
+    destroyNetSocket(serverSock);
+    unlink("testsock.sock");
+
+    clientSock = newNetSocketLocalClient("testsock.sock");
+    assert(connectNetSocket(clientSock) == false);
+    destroyNetSocket(clientSock);
+
 
     /*int socket_desc;
     struct sockaddr_in server;
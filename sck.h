@@ -4,16 +4,30 @@
 #define SCK_H
 
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <signal.h>
 
 #define DEFAULT_NETSOCKET_BACKLOG 4
+#define INITIAL_NETSOCKET_RECEIVE_BUFFER 4096
+#define NETSOCKET_WRITE_POLL_MS 100 //how often a write waiting for the peer checks whether to give up
 
 typedef struct NetSocket_s {
     int socket_desc;
     struct sockaddr_in server;
+    bool bLocal; //a Unix domain socket rather than TCP
+    struct sockaddr_un localAddress; //only used when bLocal
     int errorNumber;
+    char * receiveBuffer; //bytes received but not yet returned as lines
+    size_t receiveCapacity;
+    size_t receiveStart;
+    size_t receiveEnd;
+    bool bReceiveClosed; //the peer has finished sending
+    int writeTimeoutMs; //how long a write may wait for the peer to make room, or -1 for ever
+    volatile sig_atomic_t * bCancelWrites; //if not NULL, writes waiting for the peer give up once it is set
 } NetSocket_t;
 
 typedef struct SocketPayload_s {
@@ -25,13 +39,23 @@ typedef struct SocketPayload_s {
 NetSocket_t * newNetSocketClient(char * address, uint16_t port);
 bool connectNetSocket(NetSocket_t * socket);
 
+NetSocket_t * newNetSocketLocalClient(char * path);
+
 NetSocket_t * newNetSocketServer(uint16_t port);
+NetSocket_t * newNetSocketLocalServer(char * path);
 bool listenNetSocket(NetSocket_t * socket);
 NetSocket_t * acceptNetSocket(NetSocket_t * serverSocket);
 
 SocketPayload_t * readNetSocket(NetSocket_t * socket, size_t numBytes);
 SocketPayload_t * readLineNetSocket(NetSocket_t * socket);
+ssize_t receiveNetSocket(NetSocket_t * socket);
+char * nextLineNetSocket(NetSocket_t * socket, size_t * length);
+bool hasLineNetSocket(NetSocket_t * socket);
 bool writeNetSocket(NetSocket_t * socket, char * bytes, size_t numBytes);
+bool writevNetSocket(NetSocket_t * socket, struct iovec * iov, int count);
+int waitReadableNetSocket(NetSocket_t * socket, int timeoutMs);
+void shutdownNetSocket(NetSocket_t * socket);
+bool setNonBlockingNetSocket(NetSocket_t * socket);
 
 void destroyNetSocket(NetSocket_t * sock);
 
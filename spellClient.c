@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <assert.h>
+#include "spellClient.h"
+
+/* Wraps a socket which was created for a server in a SpellClient_t,
+connecting it. Returns NULL and destroys the socket if it couldn't connect. */
+static SpellClient_t * connectSpellClient(NetSocket_t * socket) {
+    if (socket->errorNumber != 0 || connectNetSocket(socket) == false) {
+        destroyNetSocket(socket);
+        return NULL;
+    }
+
+    SpellClient_t * client = (SpellClient_t *) malloc(sizeof (SpellClient_t));
+    client->socket = socket;
+    client->request = NULL;
+    client->requestCapacity = 0;
+    return client;
+}
+
+/* Connects to a spell server listening on a TCP port. address is a dotted
+IPv4 address. Returns NULL if the server couldn't be reached. */
+SpellClient_t * newSpellClient(char * address, uint16_t port) {
+    return connectSpellClient(newNetSocketClient(address, port));
+}
+
+/* Connects to a spell server listening on the Unix domain socket at path (see
+spell's -u option), which avoids the TCP/IP stack for clients on the same
+host. Returns NULL if the server couldn't be reached. */
+SpellClient_t * newLocalSpellClient(char * path) {
+    return connectSpellClient(newNetSocketLocalClient(path));
+}
+
+/* Disconnects from the server and deallocates the SpellClient_t. */
+void destroySpellClient(SpellClient_t * client) {
+    destroyNetSocket(client->socket);
+    free(client->request);
+    free(client);
+}
+
+/* Returns the next line sent by the server, waiting for it if necessary, or
+NULL if the server disconnected first. */
+static char * readResponseLine(SpellClient_t * client, size_t * length) {
+    char * line = NULL;
+    while ((line = nextLineNetSocket(client->socket, length)) == NULL) {
+        if (client->socket->bReceiveClosed || receiveNetSocket(client->socket) <= 0) {
+            return NULL;
+        }
+    }
+    return line;
+}
+
+/* Checks following words against the union of the comma separated dictionary
+names, as the server's "!dict" command. Returns false if the server doesn't
+have one of them. */
+bool selectSpellClientDictionaries(SpellClient_t * client, char * names) {
+    size_t length = strlen(names);
+    char * command = (char *) malloc(length + 8);
+    sprintf(command, "!dict %s\n", names);
+    bool bSent = writeNetSocket(client->socket, command, length + 7);
+    free(command);
+
+    char * response = bSent ? readResponseLine(client, &length) : NULL;
+    return response != NULL && strcmp(response, "!dict OK") == 0;
+}
+
+/* Returns true if word can be sent to the server as a request line. Empty
+words, words beginning with '!' and words with line breaks can't be, and are
+never correct. */
+static bool isRequestWord(char * word) {
+    return word[0] != '\0' && word[0] != '!' && strchr(word, '\n') == NULL;
+}
+
+/* Checks numWords null terminated words, storing whether each was spelled
+correctly in bCorrect. The words are pipelined: they are sent as fast as the
+server accepts them while the responses are read as they arrive, so a batch
+costs about one round trip however many words it has. Returns false if the
+server disconnected or refused the request, in which case bCorrect is
+incomplete. */
+bool checkWordsSpellClient(SpellClient_t * client, char ** words, size_t numWords, bool * bCorrect) {
+    size_t requestLength = 0;
+    for (size_t i = 0; i < numWords; i++) {
+        bCorrect[i] = false;
+        if (isRequestWord(words[i]) == false) {
+            continue;
+        }
+        size_t length = strlen(words[i]);
+        if (requestLength + length + 1 > client->requestCapacity) {
+            client->requestCapacity = (requestLength + length + 1) * 2;
+            client->request = (char *) realloc(client->request, client->requestCapacity);
+        }
+        memcpy(client->request + requestLength, words[i], length);
+        client->request[requestLength + length] = '\n';
+        requestLength += length + 1;
+    }
+
+    size_t sent = 0;
+    size_t nextWord = 0; //the word the next response belongs to
+    while (true) {
+        //answer every response already received
+        char * line = NULL;
+        size_t length = 0;
+        while ((line = nextLineNetSocket(client->socket, &length)) != NULL) {
+            if (line[0] == '!') {
+                return false; //for example "!ERROR server busy"
+            }
+            while (nextWord < numWords && isRequestWord(words[nextWord]) == false) {
+                nextWord++;
+            }
+            if (nextWord == numWords) {
+                return false;
+            }
+            bCorrect[nextWord++] = length > 3 && strcmp(line + length - 3, " OK") == 0;
+        }
+        while (nextWord < numWords && isRequestWord(words[nextWord]) == false) {
+            nextWord++;
+        }
+        if (nextWord == numWords) {
+            return true;
+        }
+        if (client->socket->bReceiveClosed) {
+            return false;
+        }
+
+        //send more of the request while waiting, so neither side blocks the other
+        struct pollfd pfd;
+        pfd.fd = client->socket->socket_desc;
+        pfd.events = POLLIN | (sent < requestLength ? POLLOUT : 0);
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (pfd.revents & POLLOUT) {
+            ssize_t written = send(pfd.fd, client->request + sent, requestLength - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                return false;
+            }
+            sent += written > 0 ? written : 0;
+        }
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (receiveNetSocket(client->socket) < 0) {
+                return false;
+            }
+        }
+    }
+}
+
+#define TEST_SPELL_CLIENT_WORDS 50000
+
+/* Thread function for testSpellClient standing in for a spell server. Words
+of an even length are spelled correctly. */
+static void * testSpellServer(void * param) {
+    NetSocket_t * server = (NetSocket_t *) param;
+    NetSocket_t * connection = acceptNetSocket(server);
+    char * line = NULL;
+    size_t length = 0;
+    while (true) {
+        while ((line = nextLineNetSocket(connection, &length)) != NULL) {
+            char response[64];
+            if (strncmp(line, "!dict ", 6) == 0) {
+                sprintf(response, strcmp(line + 6, "en,ru") == 0 ? "!dict OK\n" : "!dict ERROR unknown dictionary\n");
+            } else {
+                sprintf(response, "%s %s\n", line, length % 2 == 0 ? "OK" : "MISSPELLED");
+            }
+            assert(writeNetSocket(connection, response, strlen(response)));
+        }
+        if (connection->bReceiveClosed || receiveNetSocket(connection) <= 0) {
+            break;
+        }
+    }
+    destroyNetSocket(connection);
+    return NULL;
+}
+
+/* Test cases for the spell client. The batch is large enough that neither
+side could finish sending before the other reads. */
+void testSpellClient() {
+    //batch jobs may start several clients at once
+    char path[64];
+    sprintf(path, "testclient.%d.sock", (int) getpid());
+    NetSocket_t * server = newNetSocketLocalServer(path);
+    assert(server->errorNumber == 0 && listenNetSocket(server));
+    pthread_t serverThread;
+    assert(pthread_create(&serverThread, NULL, testSpellServer, server) == 0);
+
+    SpellClient_t * client = newLocalSpellClient(path);
+    assert(client != NULL);
+    assert(selectSpellClientDictionaries(client, "en,ru"));
+    assert(selectSpellClientDictionaries(client, "xx") == false);
+
+    char ** words = (char **) malloc(sizeof (char *) * TEST_SPELL_CLIENT_WORDS);
+    bool * bCorrect = (bool *) malloc(sizeof (bool) * TEST_SPELL_CLIENT_WORDS);
+    for (size_t i = 0; i < TEST_SPELL_CLIENT_WORDS; i++) {
+        words[i] = (char *) calloc(16, 1);
+        sprintf(words[i], i % 1000 == 0 ? "!%zu" : "w%zu", i); //a few can't be sent
+    }
+    words[7][0] = '\0';
+    assert(checkWordsSpellClient(client, words, TEST_SPELL_CLIENT_WORDS, bCorrect));
+    for (size_t i = 0; i < TEST_SPELL_CLIENT_WORDS; i++) {
+        assert(bCorrect[i] == (isRequestWord(words[i]) && strlen(words[i]) % 2 == 0));
+    }
+    assert(checkWordsSpellClient(client, words, 0, bCorrect));
+
+    destroySpellClient(client);
+    pthread_join(serverThread, NULL);
+    destroyNetSocket(server);
+    unlink(path);
+    for (size_t i = 0; i < TEST_SPELL_CLIENT_WORDS; i++) {
+        free(words[i]);
+    }
+    free(words);
+    free(bCorrect);
+    assert(newLocalSpellClient(path) == NULL);
+}
@@ -0,0 +1,26 @@
+//See spellClient.c for function documentation.
+
+#ifndef SPELLCLIENT_H
+#define SPELLCLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sck.h"
+
+/* A connection to a spell server, over TCP or a Unix domain socket. */
+typedef struct SpellClient_s {
+    NetSocket_t * socket;
+    char * request; //the words of the batch being checked, one per line
+    size_t requestCapacity;
+} SpellClient_t;
+
+SpellClient_t * newSpellClient(char * address, uint16_t port);
+SpellClient_t * newLocalSpellClient(char * path);
+void destroySpellClient(SpellClient_t * client);
+
+bool selectSpellClientDictionaries(SpellClient_t * client, char * names);
+bool checkWordsSpellClient(SpellClient_t * client, char ** words, size_t numWords, bool * bCorrect);
+
+void testSpellClient();
+
+#endif /* SPELLCLIENT_H */
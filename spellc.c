@@ -0,0 +1,105 @@
+/* Command line client for spell which checks the words read from stdin, one
+per line, in large pipelined batches. Meant for batch jobs and for measuring
+the server. For example:
+
+    ./spellc -u /tmp/spell.sock < words            : every word with it's result
+    ./spellc -m -d en,ru -p 2667 < essay.txt       : only the misspelled words over TCP
+    ./spellc -t                                    : run the client's self-test and exit */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "spellClient.h"
+
+#define SPELLC_BATCH_WORDS 65536
+
+int main(int argc, char * argv[]) {
+    const char * usage = "Usage: spellc [-u <socket path> | [-a <address>] -p <port>] [-d <dictionaries>] [-m] | -t";
+    char * localPath = NULL;
+    char * address = "127.0.0.1";
+    uint16_t port = 2667;
+    char * dictionaries = NULL;
+    bool bOnlyMisspelled = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0) {
+            bOnlyMisspelled = true;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            testSpellClient(); //creates a socket in the working directory
+            puts("Self-test passed.");
+            return EXIT_SUCCESS;
+        } else if (i + 1 >= argc) {
+            puts(usage);
+            return EXIT_FAILURE;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            localPath = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            address = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0) {
+            port = (uint16_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            dictionaries = argv[++i];
+        } else {
+            puts(usage);
+            return EXIT_FAILURE;
+        }
+    }
+
+    SpellClient_t * client = localPath != NULL ? newLocalSpellClient(localPath) : newSpellClient(address, port);
+    if (client == NULL) {
+        puts("Couldn't connect to the spell server!");
+        return EXIT_FAILURE;
+    }
+    if (dictionaries != NULL && selectSpellClientDictionaries(client, dictionaries) == false) {
+        printf("The server doesn't have the dictionaries %s\n", dictionaries);
+        return EXIT_FAILURE;
+    }
+
+    char ** words = (char **) malloc(sizeof (char *) * SPELLC_BATCH_WORDS);
+    bool * bCorrect = (bool *) malloc(sizeof (bool) * SPELLC_BATCH_WORDS);
+    size_t numWords = 0, totalWords = 0;
+    char * line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length = 0;
+    bool bMore = true;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+    while (bMore) {
+        //fill a batch from stdin
+        while (numWords < SPELLC_BATCH_WORDS && (bMore = (length = getline(&line, &lineCapacity, stdin)) >= 0)) {
+            if (length > 0 && line[length - 1] == '\n') {
+                line[--length] = '\0';
+            }
+            words[numWords++] = strdup(line);
+        }
+
+        if (checkWordsSpellClient(client, words, numWords, bCorrect) == false) {
+            puts("The spell server disconnected!");
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < numWords; i++) {
+            if (bOnlyMisspelled == false || bCorrect[i] == false) {
+                printf("%s %s\n", words[i], bCorrect[i] ? "OK" : "MISSPELLED");
+            }
+            free(words[i]);
+        }
+        totalWords += numWords;
+        numWords = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fflush(stdout);
+    fprintf(stderr, "%zu words in %.3f s (%.0f words/s)\n", totalWords, seconds, seconds > 0 ? totalWords / seconds : 0.0);
+
+    free(line);
+    free(words);
+    free(bCorrect);
+    destroySpellClient(client);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,308 @@
+/* Reader for the binary logs written by spell with "-f binary". Converts the
+records of a log to text, optionally filtered, or summarizes them. The log is
+mapped into memory rather than read, so very large logs are scanned at the
+speed of the disk. For example:
+
+    ./spelllog log.bin                      : print every record as text
+    ./spelllog -r misspelled -c 3 log.bin   : misspelled words from connection 3
+    ./spelllog -s 10 log.bin                : totals and the 10 most misspelled words */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "logger.h"
+
+/* A read-only file mapped into memory. */
+struct MappedFile_s {
+    char * data;
+    size_t size;
+};
+
+/* Maps the whole of fileName into memory. Returns false if it could not be
+opened. An empty file is mapped as size 0 with no data. */
+static bool mapFile(char * fileName, struct MappedFile_s * file) {
+    int fd = open(fileName, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        return false;
+    }
+    file->size = st.st_size;
+    file->data = NULL;
+    if (file->size > 0) {
+        file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        madvise(file->data, file->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return file->data != MAP_FAILED;
+}
+
+/* The interned words of a log, indexed by word id. */
+struct WordList_s {
+    char ** words; //not null terminated; each ends at it's newline
+    size_t * lengths;
+    size_t numWords;
+    uint32_t * canonicalIds; //the first id of the same word, as a word can have several ids
+    size_t numDistinctWords;
+};
+
+/* Returns the FNV-1a hash of a word which is not null terminated. */
+static uint64_t hashWord(char * word, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) word[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Finds the first id of every word in the list, so records can be matched
+and counted by word even when the logger gave a word several ids. */
+static void findCanonicalIds(struct WordList_s * list) {
+    size_t capacity = 16;
+    while (capacity < list->numWords * 2) {
+        capacity *= 2;
+    }
+    uint32_t * table = malloc(sizeof(uint32_t) * capacity); //open addressing hash table of first ids
+    memset(table, 0xFF, sizeof(uint32_t) * capacity);
+    list->canonicalIds = malloc(sizeof(uint32_t) * (list->numWords + 1));
+    list->numDistinctWords = 0;
+
+    for (uint32_t id = 0; id < list->numWords; id++) {
+        size_t slot = hashWord(list->words[id], list->lengths[id]) & (capacity - 1);
+        while (table[slot] != UINT32_MAX && (list->lengths[table[slot]] != list->lengths[id]
+                || memcmp(list->words[table[slot]], list->words[id], list->lengths[id]) != 0)) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == UINT32_MAX) {
+            table[slot] = id;
+            list->numDistinctWords++;
+        }
+        list->canonicalIds[id] = table[slot];
+    }
+    free(table);
+}
+
+/* Returns the first id of the word a record refers to, or UINT32_MAX if it
+isn't in the list. */
+static uint32_t getRecordWordId(const BinaryLogRecord_t * record, struct WordList_s * list) {
+    uint32_t id = record->word & ~BINARY_LOG_OK_BIT;
+    return id < list->numWords ? list->canonicalIds[id] : UINT32_MAX;
+}
+
+/* Indexes the lines of a mapped words file. */
+static void indexWords(struct MappedFile_s * file, struct WordList_s * list) {
+    size_t capacity = 1024;
+    list->words = malloc(sizeof(char *) * capacity);
+    list->lengths = malloc(sizeof(size_t) * capacity);
+    list->numWords = 0;
+
+    char * line = file->data;
+    char * end = file->data + file->size;
+    while (line < end) {
+        char * newline = memchr(line, '\n', end - line);
+        if (newline == NULL) {
+            newline = end;
+        }
+        if (list->numWords == capacity) {
+            capacity *= 2;
+            list->words = realloc(list->words, sizeof(char *) * capacity);
+            list->lengths = realloc(list->lengths, sizeof(size_t) * capacity);
+        }
+        list->words[list->numWords] = line;
+        list->lengths[list->numWords] = newline - line;
+        list->numWords++;
+        line = newline + 1;
+    }
+    findCanonicalIds(list);
+}
+
+struct Filter_s {
+    bool bConnection;
+    uint32_t connectionId;
+    bool bResult;
+    bool bCorrect;
+    bool bWord;
+    uint32_t wordId; //the first id of the word
+};
+
+/* Returns true if the record passes every filter that was given. */
+static bool recordMatches(const BinaryLogRecord_t * record, struct WordList_s * list, struct Filter_s * filter) {
+    if (filter->bConnection && record->connectionId != filter->connectionId) {
+        return false;
+    }
+    if (filter->bResult && ((record->word & BINARY_LOG_OK_BIT) != 0) != filter->bCorrect) {
+        return false;
+    }
+    if (filter->bWord && getRecordWordId(record, list) != filter->wordId) {
+        return false;
+    }
+    return true;
+}
+
+static size_t * sortCounts; //the counts compareWordCounts sorts by
+
+/* qsort comparison putting word ids with higher counts first. */
+static int compareWordCounts(const void * a, const void * b) {
+    size_t countA = sortCounts[*(const uint32_t *) a];
+    size_t countB = sortCounts[*(const uint32_t *) b];
+    return (countA < countB) - (countA > countB);
+}
+
+/* Prints totals over the matching records and the topWords most often
+misspelled words among them. */
+static void summarize(const BinaryLogRecord_t * records, size_t numRecords, struct WordList_s * list,
+        struct Filter_s * filter, size_t topWords) {
+    size_t * misspellings = calloc(list->numWords + 1, sizeof(size_t));
+    size_t matched = 0, correct = 0;
+    uint32_t maxConnectionId = 0;
+    uint64_t firstTimestamp = 0, lastTimestamp = 0;
+
+    for (size_t i = 0; i < numRecords; i++) {
+        if (recordMatches(&records[i], list, filter) == false) {
+            continue;
+        }
+        if (matched == 0) {
+            firstTimestamp = records[i].timestamp;
+        }
+        lastTimestamp = records[i].timestamp;
+        matched++;
+        if (records[i].connectionId > maxConnectionId) {
+            maxConnectionId = records[i].connectionId;
+        }
+        if (records[i].word & BINARY_LOG_OK_BIT) {
+            correct++;
+        } else if (getRecordWordId(&records[i], list) != UINT32_MAX) {
+            misspellings[getRecordWordId(&records[i], list)]++;
+        }
+    }
+
+    double seconds = (lastTimestamp - firstTimestamp) / 1e9;
+    printf("records: %zu\n", matched);
+    printf("ok: %zu\n", correct);
+    printf("misspelled: %zu\n", matched - correct);
+    printf("highest connection id: %u\n", maxConnectionId);
+    printf("interned words: %zu\n", list->numDistinctWords);
+    printf("duration: %.3f s (%.0f words/s)\n", seconds, seconds > 0 ? matched / seconds : 0.0);
+
+    uint32_t * ids = malloc(sizeof(uint32_t) * (list->numWords + 1));
+    size_t numIds = 0;
+    for (uint32_t id = 0; id < list->numWords; id++) {
+        if (misspellings[id] > 0) {
+            ids[numIds++] = id;
+        }
+    }
+    sortCounts = misspellings;
+    qsort(ids, numIds, sizeof(uint32_t), compareWordCounts);
+    for (size_t i = 0; i < numIds && i < topWords; i++) {
+        printf("%10zu %.*s\n", misspellings[ids[i]], (int) list->lengths[ids[i]], list->words[ids[i]]);
+    }
+
+    free(ids);
+    free(misspellings);
+}
+
+/* Prints every matching record as "<seconds>.<nanoseconds> <connection> <word> <result>". */
+static void printRecords(const BinaryLogRecord_t * records, size_t numRecords, struct WordList_s * list,
+        struct Filter_s * filter) {
+    for (size_t i = 0; i < numRecords; i++) {
+        if (recordMatches(&records[i], list, filter) == false) {
+            continue;
+        }
+        uint32_t id = records[i].word & ~BINARY_LOG_OK_BIT;
+        printf("%llu.%09llu %u %.*s %s\n",
+                (unsigned long long) (records[i].timestamp / 1000000000),
+                (unsigned long long) (records[i].timestamp % 1000000000),
+                records[i].connectionId,
+                id < list->numWords ? (int) list->lengths[id] : 1,
+                id < list->numWords ? list->words[id] : "?",
+                (records[i].word & BINARY_LOG_OK_BIT) ? "OK" : "MISSPELLED");
+    }
+}
+
+int main(int argc, char * argv[]) {
+    const char * usage = "Usage: spelllog [-c <connection id>] [-r ok|misspelled] [-w <word>] [-s <top words>] <log file>";
+    struct Filter_s filter;
+    memset(&filter, 0, sizeof(filter));
+    char * filterWord = NULL;
+    bool bSummarize = false;
+    size_t topWords = 0;
+
+    int i = 1;
+    for (; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-c") == 0) {
+            filter.bConnection = true;
+            filter.connectionId = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            filter.bResult = true;
+            if (strcmp(argv[i + 1], "ok") == 0) {
+                filter.bCorrect = true;
+            } else if (strcmp(argv[i + 1], "misspelled") == 0) {
+                filter.bCorrect = false;
+            } else {
+                puts(usage);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-w") == 0) {
+            filterWord = argv[i + 1];
+        } else if (strcmp(argv[i], "-s") == 0) {
+            bSummarize = true;
+            topWords = (size_t) strtoul(argv[i + 1], NULL, 10);
+        } else {
+            puts(usage);
+            return EXIT_FAILURE;
+        }
+    }
+    if (i + 1 != argc) {
+        puts(usage);
+        return EXIT_FAILURE;
+    }
+
+    char * logFileName = argv[i];
+    char * wordsFileName = calloc(strlen(logFileName) + 7, 1);
+    sprintf(wordsFileName, "%s.words", logFileName);
+
+    struct MappedFile_s logFile, wordsFile;
+    if (mapFile(logFileName, &logFile) == false || mapFile(wordsFileName, &wordsFile) == false) {
+        printf("Couldn't open %s and %s\n", logFileName, wordsFileName);
+        return EXIT_FAILURE;
+    }
+    const BinaryLogHeader_t * header = (const BinaryLogHeader_t *) logFile.data;
+    if (logFile.size < sizeof(BinaryLogHeader_t) || memcmp(header->magic, BINARY_LOG_MAGIC, 8) != 0
+            || header->version != BINARY_LOG_VERSION || header->recordSize != sizeof(BinaryLogRecord_t)) {
+        printf("%s is not a binary spell log\n", logFileName);
+        return EXIT_FAILURE;
+    }
+
+    struct WordList_s list;
+    indexWords(&wordsFile, &list);
+    if (filterWord != NULL) {
+        filter.bWord = true;
+        filter.wordId = UINT32_MAX; //matches nothing if the word never appears
+        for (uint32_t id = 0; id < list.numWords; id++) {
+            if (list.lengths[id] == strlen(filterWord) && memcmp(list.words[id], filterWord, list.lengths[id]) == 0) {
+                filter.wordId = list.canonicalIds[id];
+                break;
+            }
+        }
+    }
+
+    //stdout is the bottleneck when converting, so give it a large buffer
+    setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+    const BinaryLogRecord_t * records = (const BinaryLogRecord_t *) (logFile.data + sizeof(BinaryLogHeader_t));
+    size_t numRecords = (logFile.size - sizeof(BinaryLogHeader_t)) / sizeof(BinaryLogRecord_t);
+    if (bSummarize) {
+        summarize(records, numRecords, &list, &filter, topWords);
+    } else {
+        printRecords(records, numRecords, &list, &filter);
+    }
+
+    fflush(stdout);
+    return EXIT_SUCCESS;
+}
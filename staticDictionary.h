@@ -0,0 +1,13 @@
+/* The builtin dictionary, which gendict generates into staticDictionary.c
+when spell is built. See gendict.c. */
+
+#ifndef STATICDICTIONARY_H
+#define STATICDICTIONARY_H
+
+#include "trie.h"
+
+extern const StaticTrie_t staticDictionary;
+extern const char staticDictionaryName[]; //the base name of the file it was generated from
+extern const char staticDictionaryPath[]; //that file's path, as given to gendict
+
+#endif /* STATICDICTIONARY_H */
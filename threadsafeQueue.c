@@ -16,6 +16,7 @@ ThreadsafeQueue_t * newThreadsafeQueue(size_t capacity) {
     
     q->items = 0;
     q->spaces = capacity;
+    q->closed = false;
     
     pthread_cond_init(&(q->producable), NULL);
     pthread_cond_init(&(q->consumable), NULL);
@@ -37,12 +38,16 @@ void destroyThreadsafeQueue(ThreadsafeQueue_t * queue) {
 
 /* Pushes a void pointer item to the referenced ThreadsafeQueue_t. A void pointer
 is chosen such that a pointer to any type of data structure can be placed on the
-queue. */
-void pushThreadsafeQueue(ThreadsafeQueue_t * queue, void * item) {
+queue. Returns false without pushing the item if the queue has been closed. */
+bool pushThreadsafeQueue(ThreadsafeQueue_t * queue, void * item) {
     pthread_mutex_lock(&(queue->mutex));
-    while(queue->spaces == 0) {
+    while(queue->spaces == 0 && queue->closed == false) {
         pthread_cond_wait(&(queue->producable), &(queue->mutex));
     }
+    if (queue->closed) {
+        pthread_mutex_unlock(&(queue->mutex));
+        return false;
+    }
     //put
     queue->queue[queue->tail] = item;
     queue->tail = (queue->tail + 1) % queue->capacity;
@@ -50,15 +55,40 @@ void pushThreadsafeQueue(ThreadsafeQueue_t * queue, void * item) {
     queue->items++;
     pthread_mutex_unlock(&(queue->mutex));
     pthread_cond_signal(&(queue->consumable));
+    return true;
+}
+
+/* Pushes a void pointer item to the referenced ThreadsafeQueue_t if there is
+space for it, without waiting. Returns false if the queue is full or closed,
+in which case the item was not pushed. */
+bool tryPushThreadsafeQueue(ThreadsafeQueue_t * queue, void * item) {
+    pthread_mutex_lock(&(queue->mutex));
+    if (queue->spaces == 0 || queue->closed) {
+        pthread_mutex_unlock(&(queue->mutex));
+        return false;
+    }
+    //put
+    queue->queue[queue->tail] = item;
+    queue->tail = (queue->tail + 1) % queue->capacity;
+    queue->spaces--;
+    queue->items++;
+    pthread_mutex_unlock(&(queue->mutex));
+    pthread_cond_signal(&(queue->consumable));
+    return true;
 }
 
 /* Pops an item from the referenced ThreadsafeQueue_t and returns a pointer
-to the popped item. */
+to the popped item. Once the queue has been closed, the remaining items are
+still returned in order, after which NULL is returned. */
 void * popThreadsafeQueue(ThreadsafeQueue_t * queue) {
     pthread_mutex_lock(&(queue->mutex));
-    while(queue->items == 0) {
+    while(queue->items == 0 && queue->closed == false) {
         pthread_cond_wait(&(queue->consumable), &(queue->mutex));
     }
+    if (queue->items == 0) {
+        pthread_mutex_unlock(&(queue->mutex));
+        return NULL;
+    }
     //get
     void * item = NULL;
     item = queue->queue[queue->head];
@@ -71,6 +101,45 @@ void * popThreadsafeQueue(ThreadsafeQueue_t * queue) {
     return item;
 }
 
+/* Pops an item from the referenced ThreadsafeQueue_t if there is one, without
+waiting. Returns NULL if the queue is empty. */
+void * tryPopThreadsafeQueue(ThreadsafeQueue_t * queue) {
+    pthread_mutex_lock(&(queue->mutex));
+    if (queue->items == 0) {
+        pthread_mutex_unlock(&(queue->mutex));
+        return NULL;
+    }
+    //get
+    void * item = queue->queue[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->spaces++;
+    queue->items--;
+    pthread_mutex_unlock(&(queue->mutex));
+    pthread_cond_signal(&(queue->producable));
+
+    return item;
+}
+
+/* Closes the referenced ThreadsafeQueue_t. Nothing more can be pushed to a
+closed queue, and every thread waiting on it is woken so that consumers can
+drain what is left and then see NULL. */
+void closeThreadsafeQueue(ThreadsafeQueue_t * queue) {
+    pthread_mutex_lock(&(queue->mutex));
+    queue->closed = true;
+    pthread_mutex_unlock(&(queue->mutex));
+    pthread_cond_broadcast(&(queue->consumable));
+    pthread_cond_broadcast(&(queue->producable));
+}
+
+/* Returns the number of items currently waiting on the referenced
+ThreadsafeQueue_t. */
+size_t getThreadsafeQueueItems(ThreadsafeQueue_t * queue) {
+    pthread_mutex_lock(&(queue->mutex));
+    size_t items = queue->items;
+    pthread_mutex_unlock(&(queue->mutex));
+    return items;
+}
+
 /* Function used by the testThreadsafeQueue function to emulate a producer thread. */
 static void * producerTest(void * queue) {
     ThreadsafeQueue_t * q = (ThreadsafeQueue_t *)queue;
@@ -107,6 +176,31 @@ void testThreadsafeQueue() {
     assert(strcmp(string, "abcdefghijklmnopqrstuvwxyz") == 0);
     
     pthread_join(producerThread, NULL);
+
+    //trying to push to a full queue fails without waiting
+    char a = 'a', b = 'b';
+    for (int i = 0; i < 8; i++) {
+        assert(tryPushThreadsafeQueue(queue, &a) == true);
+    }
+    assert(getThreadsafeQueueItems(queue) == 8);
+    assert(tryPushThreadsafeQueue(queue, &b) == false);
+    for (int i = 0; i < 8; i++) {
+        assert(popThreadsafeQueue(queue) == &a);
+    }
+    assert(getThreadsafeQueueItems(queue) == 0);
+    assert(tryPopThreadsafeQueue(queue) == NULL);
+    assert(tryPushThreadsafeQueue(queue, &b) == true);
+    assert(tryPopThreadsafeQueue(queue) == &b);
+
+    //a closed queue drains it's remaining items, then returns NULL
+    assert(pushThreadsafeQueue(queue, &a) == true);
+    assert(pushThreadsafeQueue(queue, &b) == true);
+    closeThreadsafeQueue(queue);
+    assert(tryPushThreadsafeQueue(queue, &a) == false);
+    assert(pushThreadsafeQueue(queue, &a) == false);
+    assert(popThreadsafeQueue(queue) == &a);
+    assert(popThreadsafeQueue(queue) == &b);
+    assert(popThreadsafeQueue(queue) == NULL);
     
     destroyThreadsafeQueue(queue);
 }
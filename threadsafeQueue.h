@@ -5,6 +5,7 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdbool.h>
 
 typedef struct ThreadsafeQueue_s {
     void ** queue;
@@ -13,6 +14,7 @@ typedef struct ThreadsafeQueue_s {
     size_t capacity;
     size_t items;
     size_t spaces;
+    bool closed;
     pthread_mutex_t mutex;
     pthread_cond_t producable;
     pthread_cond_t consumable;
@@ -21,8 +23,12 @@ typedef struct ThreadsafeQueue_s {
 ThreadsafeQueue_t * newThreadsafeQueue(size_t capacity);
 void destroyThreadsafeQueue(ThreadsafeQueue_t * queue);
 
-void pushThreadsafeQueue(ThreadsafeQueue_t * queue, void * item);
+bool pushThreadsafeQueue(ThreadsafeQueue_t * queue, void * item);
+bool tryPushThreadsafeQueue(ThreadsafeQueue_t * queue, void * item);
 void * popThreadsafeQueue(ThreadsafeQueue_t * queue);
+void * tryPopThreadsafeQueue(ThreadsafeQueue_t * queue);
+void closeThreadsafeQueue(ThreadsafeQueue_t * queue);
+size_t getThreadsafeQueueItems(ThreadsafeQueue_t * queue);
 
 void testThreadsafeQueue();
 
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+#include <time.h>
+#include "trace.h"
+
+static const char * stageNames[NUM_TRACE_STAGES] = {"receive", "lookup", "format", "write", "log_push"};
+
+static pthread_mutex_t threadsMutex = PTHREAD_MUTEX_INITIALIZER;
+static TraceThread_t * threads = NULL; //every thread which has recorded a stage
+static uint32_t numThreads = 0;
+static unsigned int sampleRate = DEFAULT_TRACE_SAMPLE_RATE;
+static __thread TraceThread_t * currentThread = NULL;
+
+/* Sets how often batches are sampled into the trace: one in every rate
+batches, or none at all if rate is 0. Must be called before any thread starts
+recording. */
+void setTraceSampleRate(unsigned int rate) {
+    sampleRate = rate;
+}
+
+/* Returns a monotonic timestamp in nanoseconds. clock_gettime is served from
+the vDSO, so this costs a few tens of nanoseconds and never enters the
+kernel. */
+uint64_t getTraceTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Returns the tracing state of the calling thread, registering it the first
+time. */
+static TraceThread_t * getTraceThread() {
+    if (currentThread == NULL) {
+        currentThread = (TraceThread_t *) calloc(1, sizeof (TraceThread_t));
+        pthread_mutex_lock(&threadsMutex);
+        currentThread->id = ++numThreads;
+        currentThread->next = threads;
+        threads = currentThread;
+        pthread_mutex_unlock(&threadsMutex);
+    }
+    return currentThread;
+}
+
+/* Marks the start of a batch of requests from a connection, and decides
+whether the stages of the batch are sampled into the trace. */
+void beginTraceBatch(uint32_t connectionId) {
+    TraceThread_t * thread = getTraceThread();
+    thread->connectionId = connectionId;
+    thread->bSampling = sampleRate > 0 && thread->batches++ % sampleRate == 0
+            && thread->numEvents < MAX_TRACE_EVENTS_PER_THREAD;
+}
+
+/* Adds a stage of the calling thread which ran from start to end to it's
+histograms, and to the trace if the current batch is sampled. */
+void recordTraceStage(TraceStage_t stage, uint64_t start, uint64_t end) {
+    TraceThread_t * thread = getTraceThread();
+    uint64_t duration = end - start;
+    int bucket = 0;
+    while (bucket < TRACE_HISTOGRAM_BUCKETS - 1 && (duration >> bucket) != 0) {
+        bucket++;
+    }
+    thread->histograms[stage][bucket]++;
+    thread->totals[stage] += duration;
+    thread->counts[stage]++;
+    if (duration > thread->maximums[stage]) {
+        thread->maximums[stage] = duration;
+    }
+
+    if (thread->bSampling == false || thread->numEvents == MAX_TRACE_EVENTS_PER_THREAD) {
+        return;
+    }
+    if (thread->numEvents == thread->eventsCapacity) {
+        thread->eventsCapacity = thread->eventsCapacity == 0 ? 1024 : thread->eventsCapacity * 2;
+        thread->events = (TraceEvent_t *) realloc(thread->events, sizeof (TraceEvent_t) * thread->eventsCapacity);
+    }
+    TraceEvent_t * event = &thread->events[thread->numEvents++];
+    event->start = start;
+    event->duration = duration > UINT32_MAX ? UINT32_MAX : (uint32_t) duration;
+    event->connectionId = thread->connectionId;
+    event->stage = stage;
+}
+
+/* Returns the upper bound in nanoseconds of the histogram bucket holding the
+given fraction of the samples. */
+static uint64_t getHistogramPercentile(uint64_t * histogram, uint64_t count, double fraction) {
+    uint64_t rank = (uint64_t) (count * fraction);
+    uint64_t seen = 0;
+    for (int i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > rank) {
+            return (uint64_t) 1 << i;
+        }
+    }
+    return (uint64_t) 1 << (TRACE_HISTOGRAM_BUCKETS - 1);
+}
+
+/* Prints one line per stage summarizing it's histogram across every thread.
+Must not be called while other threads are still recording. */
+void printTraceHistograms(FILE * f) {
+    for (int stage = 0; stage < NUM_TRACE_STAGES; stage++) {
+        uint64_t histogram[TRACE_HISTOGRAM_BUCKETS] = {0};
+        uint64_t total = 0, count = 0, maximum = 0;
+        for (TraceThread_t * thread = threads; thread != NULL; thread = thread->next) {
+            for (int i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++) {
+                histogram[i] += thread->histograms[stage][i];
+            }
+            total += thread->totals[stage];
+            count += thread->counts[stage];
+            if (thread->maximums[stage] > maximum) {
+                maximum = thread->maximums[stage];
+            }
+        }
+        fprintf(f, "trace %s count=%llu mean_ns=%llu p50_ns<%llu p99_ns<%llu max_ns=%llu\n", stageNames[stage],
+                (unsigned long long) count,
+                (unsigned long long) (count > 0 ? total / count : 0),
+                (unsigned long long) getHistogramPercentile(histogram, count, 0.5),
+                (unsigned long long) getHistogramPercentile(histogram, count, 0.99),
+                (unsigned long long) maximum);
+    }
+}
+
+/* Writes every sampled stage to fileName in the Chrome trace event format,
+which chrome://tracing and Perfetto can open. Each thread is a track and each
+stage a complete event. Must not be called while other threads are still
+recording. Returns false if the file could not be written. */
+bool dumpTrace(char * fileName) {
+    FILE * f = fopen(fileName, "w");
+    if (f == NULL) {
+        return false;
+    }
+
+    //timestamps are printed relative to the earliest event
+    uint64_t base = UINT64_MAX;
+    for (TraceThread_t * thread = threads; thread != NULL; thread = thread->next) {
+        if (thread->numEvents > 0 && thread->events[0].start < base) {
+            base = thread->events[0].start;
+        }
+    }
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", f);
+    bool bFirst = true;
+    for (TraceThread_t * thread = threads; thread != NULL; thread = thread->next) {
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+                bFirst ? "" : ",", thread->id, thread->id);
+        bFirst = false;
+        for (size_t i = 0; i < thread->numEvents; i++) {
+            TraceEvent_t * event = &thread->events[i];
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"spell\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"connection\":%u}}",
+                    stageNames[event->stage], thread->id, (event->start - base) / 1000.0,
+                    event->duration / 1000.0, event->connectionId);
+        }
+    }
+    fputs("\n]}\n", f);
+    return fclose(f) == 0;
+}
+
+/* Frees the tracing state of every thread. The threads which recorded it must
+have exited. */
+void destroyTraces() {
+    pthread_mutex_lock(&threadsMutex);
+    while (threads != NULL) {
+        TraceThread_t * next = threads->next;
+        free(threads->events);
+        free(threads);
+        threads = next;
+    }
+    numThreads = 0;
+    pthread_mutex_unlock(&threadsMutex);
+}
+
+#define TEST_TRACE_BATCHES 50
+
+/* Thread function for testTrace recording a few batches. */
+static void * testTraceThread(void * param) {
+    for (uint32_t i = 0; i < TEST_TRACE_BATCHES; i++) {
+        beginTraceBatch(i);
+        uint64_t start = getTraceTime();
+        recordTraceStage(TRACE_LOOKUP, start, start + 100);
+        recordTraceStage(TRACE_WRITE, start + 100, start + 3000);
+    }
+    return NULL;
+}
+
+/* Test cases for tracing functionality. */
+void testTrace() {
+    unsigned int oldSampleRate = sampleRate;
+    setTraceSampleRate(10);
+    pthread_t testThreads[2];
+    for (int i = 0; i < 2; i++) {
+        assert(pthread_create(&testThreads[i], NULL, testTraceThread, NULL) == 0);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(testThreads[i], NULL);
+    }
+
+    assert(numThreads == 2);
+    for (TraceThread_t * thread = threads; thread != NULL; thread = thread->next) {
+        assert(thread->counts[TRACE_LOOKUP] == TEST_TRACE_BATCHES);
+        assert(thread->histograms[TRACE_LOOKUP][7] == TEST_TRACE_BATCHES); //64 <= 100 < 128
+        assert(thread->histograms[TRACE_WRITE][12] == TEST_TRACE_BATCHES); //2048 <= 2900 < 4096
+        assert(thread->maximums[TRACE_WRITE] == 2900);
+        assert(thread->numEvents == 2 * TEST_TRACE_BATCHES / 10);
+        assert(thread->events[0].connectionId == 0 && thread->events[2].connectionId == 10);
+    }
+    assert(getHistogramPercentile(threads->histograms[TRACE_LOOKUP], TEST_TRACE_BATCHES, 0.99) == 128);
+    assert(dumpTrace("testtrace.json"));
+
+    destroyTraces();
+    setTraceSampleRate(oldSampleRate);
+}
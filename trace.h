@@ -0,0 +1,71 @@
+//See trace.c for function documentation.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_HISTOGRAM_BUCKETS 40 //bucket i counts durations below 2^i nanoseconds
+#define MAX_TRACE_EVENTS_PER_THREAD 65536 //sampled events kept before sampling stops
+#define DEFAULT_TRACE_SAMPLE_RATE 100
+
+/* The stages the time spent serving a request is split into. */
+typedef enum TraceStage_e {
+    TRACE_RECEIVE, //receiving from the client socket
+    TRACE_LOOKUP, //checking a word against the dictionaries
+    TRACE_FORMAT, //building the response to a word
+    TRACE_WRITE, //sending the responses to the client
+    TRACE_LOG_PUSH, //handing a log entry to the log thread
+    NUM_TRACE_STAGES
+} TraceStage_t;
+
+/* A single sampled stage of a request. */
+typedef struct TraceEvent_s {
+    uint64_t start; //nanoseconds, monotonic
+    uint32_t duration;
+    uint32_t connectionId;
+    TraceStage_t stage;
+} TraceEvent_t;
+
+/* The tracing state of one thread. Only the thread itself writes to it, so
+recording a stage takes no locks. */
+typedef struct TraceThread_s {
+    uint32_t id;
+    uint64_t histograms[NUM_TRACE_STAGES][TRACE_HISTOGRAM_BUCKETS];
+    uint64_t totals[NUM_TRACE_STAGES]; //nanoseconds
+    uint64_t counts[NUM_TRACE_STAGES];
+    uint64_t maximums[NUM_TRACE_STAGES];
+    TraceEvent_t * events;
+    size_t numEvents;
+    size_t eventsCapacity;
+    uint64_t batches; //used to pick which batches are sampled
+    bool bSampling; //whether the current batch is sampled
+    uint32_t connectionId; //of the current batch
+    struct TraceThread_s * next;
+} TraceThread_t;
+
+/* Instrumentation for the hot path, which compiles to nothing unless spell is
+built with "make TRACE=1". */
+#ifdef SPELL_TRACE
+#define TRACE_BATCH(connectionId) beginTraceBatch(connectionId)
+#define TRACE_START(name) uint64_t name = getTraceTime()
+#define TRACE_STOP(stage, name) recordTraceStage(stage, name, getTraceTime())
+#else
+#define TRACE_BATCH(connectionId)
+#define TRACE_START(name)
+#define TRACE_STOP(stage, name)
+#endif
+
+void setTraceSampleRate(unsigned int rate);
+uint64_t getTraceTime();
+void beginTraceBatch(uint32_t connectionId);
+void recordTraceStage(TraceStage_t stage, uint64_t start, uint64_t end);
+void printTraceHistograms(FILE * f);
+bool dumpTrace(char * fileName);
+void destroyTraces();
+
+void testTrace();
+
+#endif /* TRACE_H */
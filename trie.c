@@ -10,8 +10,10 @@ Trie_t * newTrie(TrieValue_t value, bool endOfString) {
     Trie_t * tree = (Trie_t *) malloc(sizeof (Trie_t));
     tree->value = value;
     tree->endOfString = endOfString;
+    tree->normalization = TRIE_NORMALIZE_NONE;
     tree->numChildren = 0;
     tree->childrenCapacity = INITIAL_TRIE_CHILDREN;
+    tree->childValues = (TrieValue_t *) malloc(INITIAL_TRIE_CHILDREN * sizeof (TrieValue_t));
     tree->children = (Trie_t **) malloc(INITIAL_TRIE_CHILDREN * sizeof (Trie_t *));
     for (size_t i = 0; i < INITIAL_TRIE_CHILDREN; i++) {
         tree->children[i] = NULL;
@@ -23,22 +25,66 @@ Trie_t * newTrie(TrieValue_t value, bool endOfString) {
 it's children as well. */
 void destroyTrie(Trie_t * tree) {
     if (tree == NULL) { return; }
-    
+
     //recursively destroy children
     for (size_t i = 0; i < tree->numChildren; i++) {
         destroyTrie(tree->children[i]);
     }
+    free(tree->childValues);
     free(tree->children);
     free(tree);
 }
 
+/* Returns the number of bytes of memory used by a single Trie_t node, not
+counting it's children or allocator overhead. */
+static size_t getTrieNodeMemoryUsage(Trie_t * tree) {
+    return sizeof (Trie_t) + tree->childrenCapacity * (sizeof (TrieValue_t) + sizeof (Trie_t *));
+}
+
+/* Returns the number of bytes of memory used by a Trie_t and all of it's
+children, not counting allocator overhead. */
+size_t getTrieMemoryUsage(Trie_t * tree) {
+    size_t bytes = getTrieNodeMemoryUsage(tree);
+    for (size_t i = 0; i < tree->numChildren; i++) {
+        bytes += getTrieMemoryUsage(tree->children[i]);
+    }
+    return bytes;
+}
+
+/* Returns the index of the first of numValues sorted values which is not less
+than val. Wide arrays (common near the root of non-Latin dictionaries) are
+binary searched, and narrow ones are scanned. */
+static size_t searchTrieValues(const TrieValue_t * values, size_t numValues, TrieValue_t val) {
+    size_t low = 0;
+    size_t high = numValues;
+    while (high - low > TRIE_LINEAR_SEARCH_CHILDREN) {
+        size_t mid = low + (high - low) / 2;
+        if (values[mid] < val) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    while (low < high && values[low] < val) {
+        low++;
+    }
+    return low;
+}
+
+/* Returns the index of the first child of tree whose value is not less than
+val, which is where a child with value val is or would be inserted. The
+childValues array is kept sorted, so it can be searched without touching the
+children themselves. */
+static size_t findChildIndexOfTrie(Trie_t * tree, TrieValue_t val) {
+    return searchTrieValues(tree->childValues, tree->numChildren, val);
+}
+
 /* Search a Trie_t for a particular value specified by val. Returns a pointer
 to the child if it is found, otherwise NULL. */
 static Trie_t * getChildOfTrie(Trie_t * tree, TrieValue_t val) {
-    for (size_t i = 0; i < tree->numChildren; i++) {
-        if (tree->children[i]->value == val) {
-            return tree->children[i];
-        }
+    size_t i = findChildIndexOfTrie(tree, val);
+    if (i < tree->numChildren && tree->childValues[i] == val) {
+        return tree->children[i];
     }
     return NULL;
 }
@@ -47,57 +93,216 @@ static Trie_t * getChildOfTrie(Trie_t * tree, TrieValue_t val) {
 exist. Otherwise returns a pointer to the existing child with matching
 value. */
 static Trie_t * addChildToTrie(Trie_t * tree, TrieValue_t val, bool endOfString) {
-    Trie_t * existingChild = NULL;
-    existingChild = getChildOfTrie(tree, val);
-    if (existingChild != NULL) {
+    size_t i = findChildIndexOfTrie(tree, val);
+    if (i < tree->numChildren && tree->childValues[i] == val) {
         if (endOfString) {
-            existingChild->endOfString = true; //update this flag if the "new" child has it
+            tree->children[i]->endOfString = true; //update this flag if the "new" child has it
         }
-        return existingChild;
+        return tree->children[i];
     }
 
-    if (tree->numChildren >= tree->childrenCapacity - 1) {
-        Trie_t ** newChildren = (Trie_t **) malloc(sizeof (Trie_t *) * (tree->childrenCapacity * 2));
-        memcpy(newChildren, tree->children, sizeof (Trie_t *) * tree->numChildren);
-        free(tree->children);
-        tree->children = newChildren;
-
-        if (newChildren == NULL) {
+    if (tree->numChildren == tree->childrenCapacity) {
+        size_t newCapacity = tree->childrenCapacity * 2;
+        TrieValue_t * newChildValues = (TrieValue_t *) realloc(tree->childValues, sizeof (TrieValue_t) * newCapacity);
+        Trie_t ** newChildren = (Trie_t **) realloc(tree->children, sizeof (Trie_t *) * newCapacity);
+        if (newChildValues == NULL || newChildren == NULL) {
             puts("Memory allocation failed!");
             exit(EXIT_FAILURE);
         }
-        tree->childrenCapacity *= 2;
+        tree->childValues = newChildValues;
+        tree->children = newChildren;
+        tree->childrenCapacity = newCapacity;
     }
 
-    tree->children[tree->numChildren] = newTrie(val, endOfString);
+    //shift larger children up one slot to keep the arrays sorted
+    memmove(&tree->childValues[i + 1], &tree->childValues[i], sizeof (TrieValue_t) * (tree->numChildren - i));
+    memmove(&tree->children[i + 1], &tree->children[i], sizeof (Trie_t *) * (tree->numChildren - i));
+    tree->childValues[i] = val;
+    tree->children[i] = newTrie(val, endOfString);
     tree->numChildren++;
 
-    return tree->children[tree->numChildren - 1];
+    return tree->children[i];
+}
+
+/* Decodes one UTF-8 sequence from the null-terminated string into a code point
+stored in val, and returns the number of bytes consumed. A byte which does not
+begin a well formed sequence is consumed on it's own and mapped to a lone
+surrogate (U+DC80 through U+DCFF), which can never collide with a code point
+decoded from valid UTF-8. Overlong forms, encoded surrogates and values above
+U+10FFFF are not well formed. */
+static size_t decodeUtf8(const char * string, TrieValue_t * val) {
+    const unsigned char * s = (const unsigned char *) string;
+    size_t length = 0;
+    TrieValue_t codePoint = 0;
+
+    if (s[0] < 0x80) {
+        *val = s[0];
+        return 1;
+    } else if ((s[0] & 0xE0) == 0xC0) {
+        length = 2;
+        codePoint = s[0] & 0x1F;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        length = 3;
+        codePoint = s[0] & 0x0F;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        length = 4;
+        codePoint = s[0] & 0x07;
+    } else {
+        *val = 0xDC00 + s[0];
+        return 1;
+    }
+
+    for (size_t i = 1; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) { //also stops at the null terminator
+            *val = 0xDC00 + s[0];
+            return 1;
+        }
+        codePoint = (codePoint << 6) | (s[i] & 0x3F);
+    }
+
+    //the smallest code point which needs each length
+    static const TrieValue_t minCodePoints[5] = {0, 0, 0x80, 0x800, 0x10000};
+    if (codePoint < minCodePoints[length] || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF) {
+        *val = 0xDC00 + s[0];
+        return 1;
+    }
+    *val = codePoint;
+    return length;
+}
+
+/* Returns the lowercase form of an uppercase Basic Latin, Latin-1, Greek or
+Cyrillic letter. Any other code point is returned unchanged. */
+static TrieValue_t lowerTrieValue(TrieValue_t val) {
+    if ((val >= 'A' && val <= 'Z')
+            || (val >= 0xC0 && val <= 0xDE && val != 0xD7)
+            || (val >= 0x391 && val <= 0x3A9 && val != 0x3A2)
+            || (val >= 0x410 && val <= 0x42F)) {
+        return val + 0x20;
+    }
+    if (val >= 0x400 && val <= 0x40F) {
+        return val + 0x50;
+    }
+    return val;
+}
+
+/* Returns the uppercase form of a lowercase Basic Latin, Latin-1, Greek or
+Cyrillic letter. Any other code point is returned unchanged. */
+static TrieValue_t upperTrieValue(TrieValue_t val) {
+    if ((val >= 'a' && val <= 'z')
+            || (val >= 0xE0 && val <= 0xFE && val != 0xF7)
+            || (val >= 0x3B1 && val <= 0x3C9 && val != 0x3C2)
+            || (val >= 0x430 && val <= 0x44F)) {
+        return val - 0x20;
+    }
+    if (val >= 0x450 && val <= 0x45F) {
+        return val - 0x50;
+    }
+    return val;
+}
+
+/* Base letters for the Latin-1 Supplement block U+00C0 through U+00FF, used
+when folding accents. Entries of 0 have no sensible base letter and are left
+as they are. */
+static const char latin1AccentFolds[64] =
+    "AAAAAA\0CEEEEIIIIDNOOOOO\0OUUUUY\0\0"
+    "aaaaaa\0ceeeeiiiidnooooo\0ouuuuy\0y";
+
+/* Returns the normalized form of a single code point according to the
+provided normalization policy. */
+static TrieValue_t normalizeTrieValue(TrieNormalization_t normalization, TrieValue_t val) {
+    if ((normalization & TRIE_NORMALIZE_ACCENTS) && val >= 0xC0 && val <= 0xFF
+            && latin1AccentFolds[val - 0xC0] != 0) {
+        val = (TrieValue_t) latin1AccentFolds[val - 0xC0];
+    }
+    if (normalization & TRIE_NORMALIZE_CASE) {
+        val = lowerTrieValue(val);
+    }
+    return val;
+}
+
+/* Inserts a string of length code points to the trie, normalizing each one
+according to the policy of the trie. */
+static void insertCodePointsToTrie(Trie_t * tree, TrieValue_t * codePoints, size_t length) {
+    Trie_t * currentNode = tree;
+    for (size_t i = 0; i < length; i++) {
+        currentNode = addChildToTrie(currentNode, normalizeTrieValue(tree->normalization, codePoints[i]), false);
+    }
+    currentNode->endOfString = true;
+}
+
+/* Decodes the null-terminated UTF-8 string and returns a newly allocated array
+of the forms of it which are inserted to a trie with the given normalization
+policy, one after another, each *length code points long. The first form is
+the string itself. With TRIE_NORMALIZE_CAPITALIZED it's Capitalized and ALL
+CAPS forms follow. The number of forms is stored in numForms. */
+static TrieValue_t * getTrieStringForms(TrieNormalization_t normalization, char * string, size_t * length, size_t * numForms) {
+    //a string never has more code points than bytes
+    size_t maxLength = strlen(string);
+    TrieValue_t * forms = (TrieValue_t *) malloc(sizeof (TrieValue_t) * (maxLength * 3 + 1));
+    *length = 0;
+    for (size_t i = 0; string[i] != '\0'; (*length)++) {
+        i += decodeUtf8(&string[i], &forms[*length]);
+    }
+    *numForms = 1;
+
+    if ((normalization & TRIE_NORMALIZE_CAPITALIZED) != 0
+            && (normalization & TRIE_NORMALIZE_CASE) == 0 && *length > 0) {
+        if (upperTrieValue(forms[0]) != forms[0]) {
+            TrieValue_t * capitalized = &forms[*numForms * *length];
+            memcpy(capitalized, forms, sizeof (TrieValue_t) * *length);
+            capitalized[0] = upperTrieValue(capitalized[0]);
+            (*numForms)++;
+        }
+        TrieValue_t * upper = &forms[*numForms * *length];
+        for (size_t i = 0; i < *length; i++) {
+            upper[i] = upperTrieValue(forms[i]);
+        }
+        (*numForms)++;
+    }
+    return forms;
 }
 
 /* Should always insert to the tree who's root node is NULL/0/empty
 string value. The root node is essentially ignored when looking up
-strings in the trie. 
+strings in the trie. The string is decoded as UTF-8 and each code point
+becomes one level of the trie. The normalization policy of the root node is
+applied to the string, and with TRIE_NORMALIZE_CAPITALIZED the Capitalized and
+ALL CAPS variants of the string are inserted as well, so that lookups never
+need to consider variants themselves.
 
 Note: string must be null-terminated or this function will have
 undefined behavior. */
-bool insertStringToTrie(Trie_t * tree, TrieValue_t * string) {
-    Trie_t * currentNode = tree;
-    for (size_t i = 0; string[i] != '\0'; i++) {
-        currentNode = addChildToTrie(currentNode, string[i], false);
+bool insertStringToTrie(Trie_t * tree, char * string) {
+    size_t length = 0, numForms = 0;
+    TrieValue_t * forms = getTrieStringForms(tree->normalization, string, &length, &numForms);
+    for (size_t i = 0; i < numForms; i++) {
+        insertCodePointsToTrie(tree, &forms[i * length], length);
     }
-    currentNode->endOfString = true;
+    free(forms);
     return true;
 }
 
-/* Returns true if the null-terminated string of type TrieValue_t is contained
-in the Trie_t referenced by tree. Returns false otherwise.
+/* Returns true if the null-terminated UTF-8 string is contained in the Trie_t
+referenced by tree. Returns false otherwise. The string is decoded and
+normalized one code point at a time as the trie is walked, so no copy of it
+is made, and ASCII bytes skip decoding entirely.
 This is the bread-and-butter of it's application in spell checking/dictionary
 lookup. */
-bool stringExistsInTrie(Trie_t * tree, TrieValue_t * string) {
+bool stringExistsInTrie(Trie_t * tree, char * string) {
     Trie_t * currentNode = tree;
-    for (size_t i = 0; string[i] != '\0'; i++) {
-        currentNode = getChildOfTrie(currentNode, string[i]);
+    TrieNormalization_t normalization = tree->normalization;
+    for (size_t i = 0; string[i] != '\0';) {
+        TrieValue_t val = (unsigned char) string[i];
+        if (val < 0x80) {
+            i++;
+        } else {
+            i += decodeUtf8(&string[i], &val);
+        }
+        if (normalization != TRIE_NORMALIZE_NONE) {
+            val = normalizeTrieValue(normalization, val);
+        }
+
+        currentNode = getChildOfTrie(currentNode, val);
         if (currentNode == NULL) {
             return false;
         }
@@ -109,10 +314,181 @@ bool stringExistsInTrie(Trie_t * tree, TrieValue_t * string) {
     return true;
 }
 
-/* Creates a new Trie_t from a dictionary. The provided dictionary should be a 
-text file full of words delimited by newline characters */
-Trie_t * newTrieFromDictionary(char * dictionaryFileName) {
+/* Returns true if the string of length code points is contained in the trie,
+normalizing each one according to the policy of the trie. */
+static bool codePointsExistInTrie(Trie_t * tree, TrieValue_t * codePoints, size_t length) {
+    Trie_t * currentNode = tree;
+    for (size_t i = 0; i < length && currentNode != NULL; i++) {
+        currentNode = getChildOfTrie(currentNode, normalizeTrieValue(tree->normalization, codePoints[i]));
+    }
+    return currentNode != NULL && currentNode->endOfString;
+}
+
+/* Returns how many of the variants insertStringToTrie would insert for the
+null-terminated UTF-8 string are contained in the trie, and stores the number
+of variants in numForms. Inserting the string changes the trie unless all of
+them are contained, and removing it changes the trie if any are. */
+size_t countStringFormsInTrie(Trie_t * tree, char * string, size_t * numForms) {
+    size_t length = 0;
+    TrieValue_t * forms = getTrieStringForms(tree->normalization, string, &length, numForms);
+    size_t numContained = 0;
+    for (size_t i = 0; i < *numForms; i++) {
+        numContained += codePointsExistInTrie(tree, &forms[i * length], length);
+    }
+    free(forms);
+    return numContained;
+}
+
+/* Allocates a copy of a single Trie_t node, sharing it's children with the
+original. */
+static Trie_t * copyTrieNode(Trie_t * tree) {
+    Trie_t * copy = (Trie_t *) malloc(sizeof (Trie_t));
+    *copy = *tree;
+    copy->childrenCapacity = tree->numChildren + 1;
+    copy->childValues = (TrieValue_t *) malloc(sizeof (TrieValue_t) * copy->childrenCapacity);
+    copy->children = (Trie_t **) malloc(sizeof (Trie_t *) * copy->childrenCapacity);
+    memcpy(copy->childValues, tree->childValues, sizeof (TrieValue_t) * tree->numChildren);
+    memcpy(copy->children, tree->children, sizeof (Trie_t *) * tree->numChildren);
+    return copy;
+}
+
+/* Deallocates a single Trie_t node, but not it's children. */
+static void freeTrieNode(Trie_t * tree) {
+    free(tree->childValues);
+    free(tree->children);
+    free(tree);
+}
+
+/* Adds a node which has been replaced by a copy to the retire list. */
+static void retireTrieNode(TrieRetireList_t * retired, Trie_t * tree) {
+    retired->memoryChange -= getTrieNodeMemoryUsage(tree);
+    if (retired->numNodes == retired->capacity) {
+        retired->capacity = retired->capacity == 0 ? 64 : retired->capacity * 2;
+        retired->nodes = (Trie_t **) realloc(retired->nodes, sizeof (Trie_t *) * retired->capacity);
+    }
+    retired->nodes[retired->numNodes++] = tree;
+}
+
+/* Copies the root of tree and the path of a string of length code points
+below it, so the copies can be changed without disturbing readers of tree.
+Each node on the path which was copied is replaced by it's copy in the copied
+parent and added to the retire list. The copied path is stored in path,
+which must have room for length + 1 nodes; it is cut short where the string
+leaves the trie, and the number of nodes stored is returned. */
+static size_t copyTriePath(Trie_t * tree, TrieValue_t * codePoints, size_t length, Trie_t ** path, TrieRetireList_t * retired) {
+    path[0] = copyTrieNode(tree);
+    retired->memoryChange += getTrieNodeMemoryUsage(path[0]);
+    retireTrieNode(retired, tree);
+    size_t depth = 1;
+    for (; depth <= length; depth++) {
+        Trie_t * parent = path[depth - 1];
+        TrieValue_t val = normalizeTrieValue(tree->normalization, codePoints[depth - 1]);
+        size_t i = findChildIndexOfTrie(parent, val);
+        if (i == parent->numChildren || parent->childValues[i] != val) {
+            break;
+        }
+        path[depth] = copyTrieNode(parent->children[i]);
+        retired->memoryChange += getTrieNodeMemoryUsage(path[depth]);
+        retireTrieNode(retired, parent->children[i]);
+        parent->children[i] = path[depth];
+    }
+    return depth;
+}
+
+/* Returns a new root for a trie which also contains the null-terminated UTF-8
+string, normalized and with the same variants as insertStringToTrie, while
+tree itself is left unchanged. Only the nodes on the path of the string are
+copied; the rest are shared with tree, and the nodes of tree which the new
+root no longer reaches are added to the retire list. This lets a trie which
+is being read by other threads be updated by publishing the new root. If the
+string is already contained, tree itself is returned. */
+Trie_t * insertStringToTrieCopy(Trie_t * tree, char * string, TrieRetireList_t * retired) {
+    size_t length = 0, numForms = 0;
+    TrieValue_t * forms = getTrieStringForms(tree->normalization, string, &length, &numForms);
+    Trie_t ** path = (Trie_t **) malloc(sizeof (Trie_t *) * (length + 1));
+
+    for (size_t i = 0; i < numForms; i++) {
+        TrieValue_t * codePoints = &forms[i * length];
+        if (codePointsExistInTrie(tree, codePoints, length)) {
+            continue;
+        }
+
+        size_t depth = copyTriePath(tree, codePoints, length, path, retired);
+        tree = path[0];
+
+        //the rest of the string is new, and it's parent may grow
+        Trie_t * currentNode = path[depth - 1];
+        retired->memoryChange -= getTrieNodeMemoryUsage(currentNode);
+        for (size_t j = depth - 1; j < length; j++) {
+            currentNode = addChildToTrie(currentNode, normalizeTrieValue(tree->normalization, codePoints[j]), false);
+            retired->memoryChange += getTrieNodeMemoryUsage(currentNode);
+        }
+        retired->memoryChange += getTrieNodeMemoryUsage(path[depth - 1]);
+        currentNode->endOfString = true;
+    }
+
+    free(path);
+    free(forms);
+    return tree;
+}
+
+/* Returns a new root for a trie which no longer contains the null-terminated
+UTF-8 string or any of the variants insertStringToTrie would have inserted
+with it, while tree itself is left unchanged. Nodes left with no words below
+them are dropped. As with insertStringToTrieCopy, only the path of the string
+is copied and the nodes of tree which were replaced are added to the retire
+list. If the string is not contained, tree itself is returned. */
+Trie_t * removeStringFromTrieCopy(Trie_t * tree, char * string, TrieRetireList_t * retired) {
+    size_t length = 0, numForms = 0;
+    TrieValue_t * forms = getTrieStringForms(tree->normalization, string, &length, &numForms);
+    Trie_t ** path = (Trie_t **) malloc(sizeof (Trie_t *) * (length + 1));
+
+    for (size_t i = 0; i < numForms; i++) {
+        TrieValue_t * codePoints = &forms[i * length];
+        if (codePointsExistInTrie(tree, codePoints, length) == false) {
+            continue;
+        }
+
+        copyTriePath(tree, codePoints, length, path, retired);
+        tree = path[0];
+        path[length]->endOfString = false;
+
+        //the copies are not reachable by any reader yet, so can be freed at once
+        for (size_t depth = length; depth > 0 && path[depth]->numChildren == 0 && path[depth]->endOfString == false; depth--) {
+            Trie_t * parent = path[depth - 1];
+            size_t index = findChildIndexOfTrie(parent, path[depth]->value);
+            memmove(&parent->childValues[index], &parent->childValues[index + 1], sizeof (TrieValue_t) * (parent->numChildren - index - 1));
+            memmove(&parent->children[index], &parent->children[index + 1], sizeof (Trie_t *) * (parent->numChildren - index - 1));
+            parent->numChildren--;
+            retired->memoryChange -= getTrieNodeMemoryUsage(path[depth]);
+            freeTrieNode(path[depth]);
+        }
+    }
+
+    free(path);
+    free(forms);
+    return tree;
+}
+
+/* Deallocates every node on the retire list, but not their children, which
+are shared with a newer root, and empties the list. */
+void freeRetiredTrieNodes(TrieRetireList_t * retired) {
+    for (size_t i = 0; i < retired->numNodes; i++) {
+        freeTrieNode(retired->nodes[i]);
+    }
+    free(retired->nodes);
+    retired->nodes = NULL;
+    retired->numNodes = 0;
+    retired->capacity = 0;
+    retired->memoryChange = 0;
+}
+
+/* Creates a new Trie_t from a dictionary. The provided dictionary should be a
+UTF-8 text file full of words delimited by newline characters. Every word is
+normalized according to the provided policy as it is inserted. */
+Trie_t * newTrieFromDictionary(char * dictionaryFileName, TrieNormalization_t normalization) {
     Trie_t * tree = newTrie(0, false);
+    tree->normalization = normalization;
 
     char * string = NULL;
     size_t len = 0;
@@ -137,11 +513,124 @@ Trie_t * newTrieFromDictionary(char * dictionaryFileName) {
 
         }
     } while (bytesRead != -1);
+    free(string);
     fclose(fp);
 
     return tree;
 }
 
+/* Parses a comma separated list of normalization policy names (for example
+"case,accents") into a TrieNormalization_t. Returns false if any of the names
+is not recognized. */
+bool parseTrieNormalization(char * policyList, TrieNormalization_t * normalization) {
+    char * list = strdup(policyList);
+    char * savePtr = NULL;
+    bool bValid = true;
+
+    *normalization = TRIE_NORMALIZE_NONE;
+    for (char * name = strtok_r(list, ",", &savePtr); name != NULL; name = strtok_r(NULL, ",", &savePtr)) {
+        if (strcmp(name, "none") == 0) {
+            continue;
+        } else if (strcmp(name, "case") == 0) {
+            *normalization |= TRIE_NORMALIZE_CASE;
+        } else if (strcmp(name, "accents") == 0) {
+            *normalization |= TRIE_NORMALIZE_ACCENTS;
+        } else if (strcmp(name, "capitalized") == 0) {
+            *normalization |= TRIE_NORMALIZE_CAPITALIZED;
+        } else {
+            bValid = false;
+        }
+    }
+
+    free(list);
+    return bValid;
+}
+
+/* Returns the number of nodes in a Trie_t, including the root. */
+static size_t countTrieNodes(Trie_t * tree) {
+    size_t count = 1;
+    for (size_t i = 0; i < tree->numChildren; i++) {
+        count += countTrieNodes(tree->children[i]);
+    }
+    return count;
+}
+
+/* Flattens a Trie_t into a newly allocated StaticTrie_t with the same words
+and normalization policy, for writing out as source code or for comparing
+against the tree. numWords is recorded as the size of the dictionary. The
+arrays are allocated and must be freed with destroyFlattenedTrie. */
+StaticTrie_t * flattenTrie(Trie_t * tree, size_t numWords) {
+    StaticTrie_t * trie = (StaticTrie_t *) malloc(sizeof (StaticTrie_t));
+    trie->numNodes = countTrieNodes(tree);
+    trie->numWords = numWords;
+    trie->normalization = tree->normalization;
+    StaticTrieNode_t * nodes = (StaticTrieNode_t *) malloc(sizeof (StaticTrieNode_t) * trie->numNodes);
+    TrieValue_t * values = (TrieValue_t *) malloc(sizeof (TrieValue_t) * trie->numNodes);
+
+    //the queue of a breadth first walk is the order the nodes are stored in
+    Trie_t ** queue = (Trie_t **) malloc(sizeof (Trie_t *) * trie->numNodes);
+    size_t numQueued = 1;
+    queue[0] = tree;
+    for (size_t i = 0; i < trie->numNodes; i++) {
+        Trie_t * node = queue[i];
+        nodes[i].firstChild = (uint32_t) numQueued;
+        nodes[i].numChildren = (uint32_t) node->numChildren | (node->endOfString ? STATIC_TRIE_END_OF_STRING : 0);
+        values[i] = node->value;
+        for (size_t c = 0; c < node->numChildren; c++) {
+            queue[numQueued++] = node->children[c];
+        }
+    }
+    free(queue);
+
+    trie->nodes = nodes;
+    trie->values = values;
+    return trie;
+}
+
+/* Deallocates a StaticTrie_t returned by flattenTrie. */
+void destroyFlattenedTrie(StaticTrie_t * trie) {
+    free((void *) trie->nodes);
+    free((void *) trie->values);
+    free(trie);
+}
+
+/* Returns the number of bytes used by the arrays of a StaticTrie_t. */
+size_t getStaticTrieMemoryUsage(const StaticTrie_t * trie) {
+    return trie->numNodes * (sizeof (StaticTrieNode_t) + sizeof (TrieValue_t));
+}
+
+/* Returns true if the null-terminated UTF-8 string is contained in the
+StaticTrie_t, decoding and normalizing it in the same way as
+stringExistsInTrie. The children of a node are found by searching a slice of
+the values array, which is contiguous for every node, so a lookup touches far
+fewer cache lines than walking pointers between separately allocated
+nodes. */
+bool stringExistsInStaticTrie(const StaticTrie_t * trie, char * string) {
+    const StaticTrieNode_t * nodes = trie->nodes;
+    TrieNormalization_t normalization = trie->normalization;
+    uint32_t currentNode = 0;
+    for (size_t i = 0; string[i] != '\0';) {
+        TrieValue_t val = (unsigned char) string[i];
+        if (val < 0x80) {
+            i++;
+        } else {
+            i += decodeUtf8(&string[i], &val);
+        }
+        if (normalization != TRIE_NORMALIZE_NONE) {
+            val = normalizeTrieValue(normalization, val);
+        }
+
+        uint32_t first = nodes[currentNode].firstChild;
+        uint32_t numChildren = nodes[currentNode].numChildren & ~STATIC_TRIE_END_OF_STRING;
+        size_t index = searchTrieValues(&trie->values[first], numChildren, val);
+        if (index == numChildren || trie->values[first + index] != val) {
+            return false;
+        }
+        currentNode = first + (uint32_t) index;
+    }
+    return (nodes[currentNode].numChildren & STATIC_TRIE_END_OF_STRING) != 0;
+}
+
 /* Test cases for the Trie_t association functions. */
 void testTrie() {
     Trie_t * tree = newTrie(0, false);
@@ -155,9 +644,140 @@ void testTrie() {
 
     destroyTrie(tree);
 
-    Trie_t * dictionary = newTrieFromDictionary("words");
-    assert(stringExistsInTrie(dictionary, "hello") == true);
-    assert(stringExistsInTrie(dictionary, "guise") == true);
+    //children must stay sorted and searchable past the linear search width
+    tree = newTrie(0, false);
+    for (char c = 'z'; c >= 'a'; c--) {
+        char word[2] = { c, '\0' };
+        insertStringToTrie(tree, word);
+    }
+    assert(tree->numChildren == 26);
+    for (size_t i = 1; i < tree->numChildren; i++) {
+        assert(tree->childValues[i - 1] < tree->childValues[i]);
+    }
+    assert(stringExistsInTrie(tree, "a") == true);
+    assert(stringExistsInTrie(tree, "m") == true);
+    assert(stringExistsInTrie(tree, "z") == true);
+    assert(stringExistsInTrie(tree, "A") == false);
+    destroyTrie(tree);
+
+    //multibyte UTF-8 words take one level per code point
+    tree = newTrie(0, false);
+    insertStringToTrie(tree, "\xD0\xBC\xD0\xB8\xD1\x80"); //мир
+    insertStringToTrie(tree, "\xE6\x97\xA5\xE6\x9C\xAC"); //日本
+    assert(tree->numChildren == 2);
+    assert(getChildOfTrie(tree, 0x43C) != NULL);
+    assert(getChildOfTrie(tree, 0x43C)->numChildren == 1);
+    assert(stringExistsInTrie(tree, "\xD0\xBC\xD0\xB8\xD1\x80") == true);
+    assert(stringExistsInTrie(tree, "\xD0\xBC\xD0\xB8") == false);
+    assert(stringExistsInTrie(tree, "\xE6\x97\xA5\xE6\x9C\xAC") == true);
+    assert(stringExistsInTrie(tree, "\xE6\x97\xA5") == false);
+    assert(stringExistsInTrie(tree, "\xE6\x97") == false); //truncated sequence
+    destroyTrie(tree);
+
+    //malformed bytes never match valid UTF-8 or other malformed bytes
+    tree = newTrie(0, false);
+    insertStringToTrie(tree, "\x80");
+    insertStringToTrie(tree, "A");
+    assert(stringExistsInTrie(tree, "\xED\xB2\x80") == false); //encoded U+DC80
+    assert(stringExistsInTrie(tree, "\xC1\x81") == false); //overlong 'A'
+    assert(stringExistsInTrie(tree, "\xF4\x90\x80\x80") == false); //above U+10FFFF
+    assert(stringExistsInTrie(tree, "\x80") == true);
+    destroyTrie(tree);
+
+    tree = newTrie(0, false);
+    tree->normalization = TRIE_NORMALIZE_CASE | TRIE_NORMALIZE_ACCENTS;
+    insertStringToTrie(tree, "Caf\xC3\xA9");
+    insertStringToTrie(tree, "\xD0\x9C\xD0\xB8\xD1\x80"); //Мир
+    assert(stringExistsInTrie(tree, "cafe") == true);
+    assert(stringExistsInTrie(tree, "CAF\xC3\x89") == true);
+    assert(stringExistsInTrie(tree, "caf") == false);
+    assert(stringExistsInTrie(tree, "\xD0\x9C\xD0\x98\xD0\xA0") == true); //МИР
+    destroyTrie(tree);
+
+    tree = newTrie(0, false);
+    tree->normalization = TRIE_NORMALIZE_CAPITALIZED;
+    insertStringToTrie(tree, "hello");
+    insertStringToTrie(tree, "Paris");
+    assert(stringExistsInTrie(tree, "hello") == true);
+    assert(stringExistsInTrie(tree, "Hello") == true);
+    assert(stringExistsInTrie(tree, "HELLO") == true);
+    assert(stringExistsInTrie(tree, "hELLO") == false);
+    assert(stringExistsInTrie(tree, "PARIS") == true);
+    assert(stringExistsInTrie(tree, "paris") == false);
+    destroyTrie(tree);
+
+    //copy-on-write updates leave the old root intact until it is retired
+    TrieRetireList_t retired = { NULL, 0, 0, 0 };
+    Trie_t * original = newTrie(0, false);
+    original->normalization = TRIE_NORMALIZE_CAPITALIZED;
+    insertStringToTrie(original, "car");
+    size_t originalMemory = getTrieMemoryUsage(original);
+    tree = insertStringToTrieCopy(original, "cart", &retired);
+    assert(originalMemory + retired.memoryChange == getTrieMemoryUsage(tree));
+    assert(tree != original);
+    assert(retired.numNodes == 12); //the root and three letters for each of cart, Cart and CART
+    assert(stringExistsInTrie(tree, "cart") == true);
+    assert(stringExistsInTrie(tree, "Cart") == true);
+    assert(stringExistsInTrie(tree, "CART") == true);
+    assert(stringExistsInTrie(tree, "car") == true);
+    assert(stringExistsInTrie(original, "cart") == false);
+    assert(stringExistsInTrie(original, "car") == true);
+    assert(insertStringToTrieCopy(tree, "cart", &retired) == tree);
+    freeRetiredTrieNodes(&retired);
+    assert(retired.numNodes == 0);
+
+    size_t treeMemory = getTrieMemoryUsage(tree);
+    Trie_t * removed = removeStringFromTrieCopy(tree, "car", &retired);
+    assert(treeMemory + retired.memoryChange == getTrieMemoryUsage(removed));
+    assert(stringExistsInTrie(removed, "car") == false);
+    assert(stringExistsInTrie(removed, "CAR") == false);
+    assert(stringExistsInTrie(removed, "cart") == true);
+    assert(stringExistsInTrie(tree, "car") == true);
+    freeRetiredTrieNodes(&retired);
+    tree = removeStringFromTrieCopy(removed, "cart", &retired);
+    assert(removeStringFromTrieCopy(tree, "cart", &retired) == tree);
+    assert(stringExistsInTrie(tree, "cart") == false);
+    assert(tree->numChildren == 0); //every emptied branch is dropped
+    freeRetiredTrieNodes(&retired);
+    destroyTrie(tree);
+
+    Trie_t * dictionary = newTrieFromDictionary("words.ru", TRIE_NORMALIZE_NONE);
+    assert(stringExistsInTrie(dictionary, "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82") == true); //привет
+    assert(stringExistsInTrie(dictionary, "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82") == false); //Привет
+
+    //a flattened trie holds exactly the same words
+    StaticTrie_t * flattened = flattenTrie(dictionary, 192);
+    assert(flattened->numNodes == countTrieNodes(dictionary));
+    assert(flattened->values[flattened->nodes[0].firstChild] == 0x430); //а
+    FILE * fp = fopen("words.ru", "r");
+    char * line = NULL;
+    size_t capacity = 0;
+    while (getline(&line, &capacity, fp) > 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        assert(stringExistsInStaticTrie(flattened, line) == true);
+    }
+    free(line);
+    fclose(fp);
+    assert(stringExistsInStaticTrie(flattened, "") == false);
+    assert(stringExistsInStaticTrie(flattened, "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82") == false); //Привет
+    assert(stringExistsInStaticTrie(flattened, "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82x") == false); //приветx
+    destroyFlattenedTrie(flattened);
+    destroyTrie(dictionary);
+
+    TrieNormalization_t normalization = TRIE_NORMALIZE_NONE;
+    assert(parseTrieNormalization("case,capitalized", &normalization) == true);
+    assert(normalization == (TRIE_NORMALIZE_CASE | TRIE_NORMALIZE_CAPITALIZED));
+    assert(parseTrieNormalization("case,bogus", &normalization) == false);
+
+    dictionary = newTrieFromDictionary("words.ru", TRIE_NORMALIZE_CAPITALIZED);
+    assert(dictionary != NULL);
+    assert(stringExistsInTrie(dictionary, "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82") == true); //привет
+    assert(stringExistsInTrie(dictionary, "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82") == true); //Привет
+    assert(stringExistsInTrie(dictionary, "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5") == false); //приве
+    flattened = flattenTrie(dictionary, 192);
+    assert(stringExistsInStaticTrie(flattened, "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82") == true); //Привет
+    assert(stringExistsInStaticTrie(flattened, "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5") == false); //приве
+    destroyFlattenedTrie(flattened);
 
     destroyTrie(dictionary);
 }
@@ -7,25 +7,79 @@ See implementation file trie.c for function documentation. */
 #define TRIE_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 
 #define INITIAL_TRIE_CHILDREN 8
+#define TRIE_LINEAR_SEARCH_CHILDREN 8 //nodes wider than this are binary searched
 
-typedef char TrieValue_t;
+/* Normalization policies, combined as bit flags. The policy of a trie is stored
+on it's root node and applied both to words as they are inserted and to words
+as they are looked up. */
+#define TRIE_NORMALIZE_NONE 0x00
+#define TRIE_NORMALIZE_CASE 0x01 //case-insensitive matching of Latin, Greek and Cyrillic letters
+#define TRIE_NORMALIZE_ACCENTS 0x02 //fold accented Latin-1 letters to their base letter
+#define TRIE_NORMALIZE_CAPITALIZED 0x04 //also accept Capitalized and ALL CAPS forms of words
+
+typedef uint32_t TrieValue_t; //a Unicode code point
+typedef unsigned char TrieNormalization_t;
 
 typedef struct Trie_s {
     TrieValue_t value;
     bool endOfString;
+    TrieNormalization_t normalization; //only meaningful on the root node
     size_t numChildren;
     size_t childrenCapacity;
+    TrieValue_t * childValues; //sorted values of the children, searched before touching them
     struct Trie_s ** children; //these will point to Trie_t's
 } Trie_t;
 
+/* A trie flattened into arrays, which can be generated into a C source file
+as static const data (see gendict.c) and looked up without being built or
+allocated. Nodes are stored breadth first, so the children of each node are
+contiguous and sorted by value, and nodes[0] is the root. */
+typedef struct StaticTrieNode_s {
+    uint32_t firstChild; //index of the first child in nodes and values
+    uint32_t numChildren; //with STATIC_TRIE_END_OF_STRING set if a word ends here
+} StaticTrieNode_t;
+
+#define STATIC_TRIE_END_OF_STRING 0x80000000u
+
+typedef struct StaticTrie_s {
+    const StaticTrieNode_t * nodes;
+    const TrieValue_t * values; //the value of each node, searched apart from the nodes
+    size_t numNodes;
+    size_t numWords; //lines in the dictionary it was built from
+    TrieNormalization_t normalization;
+} StaticTrie_t;
+
+/* Nodes replaced by copy-on-write updates. Readers of the old root may still
+be using them, so they are only freed, with freeRetiredTrieNodes, once no
+reader can be. */
+typedef struct TrieRetireList_s {
+    Trie_t ** nodes;
+    size_t numNodes;
+    size_t capacity;
+    ptrdiff_t memoryChange; //bytes the updates added to the trie, less those retired
+} TrieRetireList_t;
+
 Trie_t * newTrie(TrieValue_t value, bool endOfString);
 void destroyTrie(Trie_t * tree);
+size_t getTrieMemoryUsage(Trie_t * tree);
+
+bool insertStringToTrie(Trie_t * tree, char * string);
+bool stringExistsInTrie(Trie_t * tree, char * string);
+size_t countStringFormsInTrie(Trie_t * tree, char * string, size_t * numForms);
+Trie_t * insertStringToTrieCopy(Trie_t * tree, char * string, TrieRetireList_t * retired);
+Trie_t * removeStringFromTrieCopy(Trie_t * tree, char * string, TrieRetireList_t * retired);
+void freeRetiredTrieNodes(TrieRetireList_t * retired);
+Trie_t * newTrieFromDictionary(char * dictionaryFileName, TrieNormalization_t normalization);
+bool parseTrieNormalization(char * policyList, TrieNormalization_t * normalization);
 
-bool insertStringToTrie(Trie_t * tree, TrieValue_t * string);
-bool stringExistsInTrie(Trie_t * tree, TrieValue_t * string);
-Trie_t * newTrieFromDictionary(char * dictionaryFileName);
+StaticTrie_t * flattenTrie(Trie_t * tree, size_t numWords);
+void destroyFlattenedTrie(StaticTrie_t * trie);
+size_t getStaticTrieMemoryUsage(const StaticTrie_t * trie);
+bool stringExistsInStaticTrie(const StaticTrie_t * trie, char * string);
 
 void testTrie();
 
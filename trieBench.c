@@ -0,0 +1,176 @@
+/* Benchmark for Trie_t lookups. Loads each dictionary given on the command line
+and repeatedly looks up every word in it, reporting the cost per word and per
+code point so that ASCII and non-Latin dictionaries can be compared. The same
+is then measured for the dictionary flattened into a StaticTrie_t, as it is
+built into spell. With -c every dictionary is also timed transliterated into
+Cyrillic, which compares non-Latin lookups with ASCII ones on a dictionary of
+realistic size rather than on the small words.ru. For example:
+
+    ./triebench -c words words.ru */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "trie.h"
+
+/* Returns a monotonic timestamp in nanoseconds. */
+static double nowNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Reads every line of a dictionary file into a newly allocated array of
+strings, storing the number of lines in numWords. Returns NULL if the file
+could not be opened. */
+static char ** readWords(char * fileName, size_t * numWords) {
+    FILE * fp = fopen(fileName, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    size_t capacity = 1024;
+    char ** words = (char **) malloc(sizeof (char *) * capacity);
+    char * line = NULL;
+    size_t len = 0;
+    *numWords = 0;
+    while (getline(&line, &len, fp) > 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (*numWords == capacity) {
+            capacity *= 2;
+            words = (char **) realloc(words, sizeof (char *) * capacity);
+        }
+        words[(*numWords)++] = strdup(line);
+    }
+    free(line);
+    fclose(fp);
+    return words;
+}
+
+/* Returns the number of code points in a UTF-8 string. */
+static size_t countCodePoints(char * string) {
+    size_t count = 0;
+    for (size_t i = 0; string[i] != '\0'; i++) {
+        if ((string[i] & 0xC0) != 0x80) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Returns a copy of a word with every ASCII letter replaced by a Cyrillic
+one (a to z become U+0430 to U+0449, A to Z become U+0410 to U+0429). A
+transliterated dictionary has exactly the shape of the original, but every
+letter takes two bytes, so it shows the cost of non-Latin words at a realistic
+dictionary size. */
+static char * transliterateToCyrillic(char * word) {
+    char * cyrillic = (char *) malloc(strlen(word) * 2 + 1);
+    size_t length = 0;
+    for (size_t i = 0; word[i] != '\0'; i++) {
+        unsigned int codePoint = 0;
+        if (word[i] >= 'a' && word[i] <= 'z') {
+            codePoint = 0x430 + (word[i] - 'a');
+        } else if (word[i] >= 'A' && word[i] <= 'Z') {
+            codePoint = 0x410 + (word[i] - 'A');
+        } else {
+            cyrillic[length++] = word[i];
+            continue;
+        }
+        cyrillic[length++] = (char) (0xC0 | (codePoint >> 6));
+        cyrillic[length++] = (char) (0x80 | (codePoint & 0x3F));
+    }
+    cyrillic[length] = '\0';
+    return cyrillic;
+}
+
+/* Builds a trie of numWords words, then repeatedly looks up every word in it
+and in it's flattened form, printing the cost of each. */
+static void benchmarkWords(char * label, char ** words, size_t numWords) {
+    const size_t targetLookups = 20000000;
+
+    Trie_t * dictionary = newTrie(0, false);
+    size_t codePoints = 0;
+    for (size_t i = 0; i < numWords; i++) {
+        insertStringToTrie(dictionary, words[i]);
+        codePoints += countCodePoints(words[i]);
+    }
+
+    size_t passes = targetLookups / numWords + 1;
+    size_t found = 0;
+    double start = nowNanoseconds();
+    for (size_t p = 0; p < passes; p++) {
+        for (size_t i = 0; i < numWords; i++) {
+            found += stringExistsInTrie(dictionary, words[i]);
+        }
+    }
+    double elapsed = nowNanoseconds() - start;
+
+    size_t lookups = passes * numWords;
+    printf("%s: %zu words, %zu KiB trie, %.1f ns/word, %.2f ns/code point, %.0f words/s%s\n",
+            label, numWords, getTrieMemoryUsage(dictionary) / 1024,
+            elapsed / lookups, elapsed / (passes * codePoints),
+            lookups / (elapsed / 1e9), found == lookups ? "" : " (MISSING WORDS)");
+
+    StaticTrie_t * flattened = flattenTrie(dictionary, numWords);
+    found = 0;
+    start = nowNanoseconds();
+    for (size_t p = 0; p < passes; p++) {
+        for (size_t i = 0; i < numWords; i++) {
+            found += stringExistsInStaticTrie(flattened, words[i]);
+        }
+    }
+    elapsed = nowNanoseconds() - start;
+    printf("%s (flattened): %zu KiB, %.1f ns/word, %.2f ns/code point, %.0f words/s%s\n",
+            label, getStaticTrieMemoryUsage(flattened) / 1024,
+            elapsed / lookups, elapsed / (passes * codePoints),
+            lookups / (elapsed / 1e9), found == lookups ? "" : " (MISSING WORDS)");
+
+    destroyFlattenedTrie(flattened);
+    destroyTrie(dictionary);
+}
+
+/* Frees an array of numWords words. */
+static void destroyWords(char ** words, size_t numWords) {
+    for (size_t i = 0; i < numWords; i++) {
+        free(words[i]);
+    }
+    free(words);
+}
+
+int main(int argc, char * argv[]) {
+    bool bCyrillic = argc > 1 && strcmp(argv[1], "-c") == 0;
+    int firstDictionary = bCyrillic ? 2 : 1;
+    if (argc <= firstDictionary) {
+        puts("Usage: triebench [-c] <dictionary> [dictionary ...]");
+        puts("\t-c : also time each dictionary transliterated into Cyrillic");
+        return EXIT_FAILURE;
+    }
+
+    for (int d = firstDictionary; d < argc; d++) {
+        size_t numWords = 0;
+        char ** words = readWords(argv[d], &numWords);
+        if (words == NULL || numWords == 0) {
+            printf("%s: could not load dictionary\n", argv[d]);
+            continue;
+        }
+        benchmarkWords(argv[d], words, numWords);
+
+        if (bCyrillic) {
+            char ** cyrillicWords = (char **) malloc(sizeof (char *) * numWords);
+            for (size_t i = 0; i < numWords; i++) {
+                cyrillicWords[i] = transliterateToCyrillic(words[i]);
+            }
+            char * label = (char *) malloc(strlen(argv[d]) + 16);
+            sprintf(label, "%s (Cyrillic)", argv[d]);
+            benchmarkWords(label, cyrillicWords, numWords);
+            free(label);
+            destroyWords(cyrillicWords, numWords);
+        }
+        destroyWords(words, numWords);
+    }
+
+    return EXIT_SUCCESS;
+}